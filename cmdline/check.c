@@ -25,6 +25,7 @@
 #include "state.h"
 #include "parity.h"
 #include "handle.h"
+#include "io.h"
 #include "raid/raid.h"
 #include "raid/combo.h"
 
@@ -95,44 +96,67 @@ static int blockcmp(struct snapraid_state* state, int rehash, struct snapraid_bl
 
 /**
  * Check if the hash of all the failed block we are expecting to recover are now matching.
+ * The blocks are hashed together with memhash_multi().
+ * Return !=0 if all the hashes match, otherwise ::mismatch is set to the first failed entry not matching.
  */
-static int is_hash_matching(struct snapraid_state* state, int rehash, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void* buffer_zero)
+static int is_hash_matching(struct snapraid_state* state, int rehash, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void* buffer_zero, int* mismatch)
 {
+	unsigned char hash[LEV_MAX][HASH_MAX];
+	void* hash_digest[LEV_MAX];
+	void* hash_src[LEV_MAX];
+	size_t hash_size[LEV_MAX];
+	struct failed_struct* hash_failed[LEV_MAX];
+	unsigned hash_count;
 	unsigned j;
-	int hash_checked;
 
-	hash_checked = 0; /* keep track if we check at least one block */
-
-	/* check if the recovered blocks are OK */
+	/* collect the recovered blocks that have a hash to check */
+	hash_count = 0;
 	for (j = 0; j < failed_count; ++j) {
+		struct failed_struct* f = &failed[failed_map[j]];
+
 		/* if we are expected to recover this block */
-		if (!failed[failed_map[j]].is_outofdate
+		if (!f->is_outofdate
 		        /* if the block has a hash to check */
-			&& block_has_updated_hash(failed[failed_map[j]].block)
+			&& block_has_updated_hash(f->block)
 		) {
-			/* if a hash doesn't match, fail the check */
-			unsigned pos_size = file_block_size(failed[failed_map[j]].file, failed[failed_map[j]].file_pos, state->block_size);
-			if (blockcmp(state, rehash, failed[failed_map[j]].block, pos_size, buffer[failed[failed_map[j]].index], buffer_zero) != 0) {
-				log_tag("hash_error: Hash mismatch on entry %u\n", failed_map[j]);
-				return 0;
-			}
-
-			hash_checked = 1;
+			hash_digest[hash_count] = hash[hash_count];
+			hash_src[hash_count] = buffer[f->index];
+			hash_size[hash_count] = file_block_size(f->file, f->file_pos, state->block_size);
+			hash_failed[hash_count] = f;
+			++hash_count;
 		}
 	}
 
 	/* if nothing checked, we reject it */
 	/* note that we are excluding this case at upper level */
 	/* but checking again doesn't hurt */
-	if (!hash_checked) {
+	if (hash_count == 0) {
 		/* LCOV_EXCL_START */
 		return 0;
 		/* LCOV_EXCL_STOP */
 	}
 
-	/* if we checked something, and no block failed the check */
-	/* recompute all the redundancy information */
-	raid_gen(diskmax, state->level, state->block_size, buffer);
+	/* now compute the hash of the valid part */
+	if (rehash) {
+		memhash_multi(state->prevhash, state->prevhashseed, hash_digest, hash_src, hash_size, hash_count);
+	} else {
+		memhash_multi(state->hash, state->hashseed, hash_digest, hash_src, hash_size, hash_count);
+	}
+
+	/* check if the recovered blocks are OK */
+	for (j = 0; j < hash_count; ++j) {
+		unsigned pos_size = hash_size[j];
+
+		/* compare the hash, and the end of the block */
+		if (memcmp(hash[j], hash_failed[j]->block->hash, BLOCK_HASH_SIZE) != 0
+			|| (pos_size < state->block_size
+			&& memcmp((unsigned char*)hash_src[j] + pos_size, (unsigned char*)buffer_zero + pos_size, state->block_size - pos_size) != 0)
+		) {
+			*mismatch = hash_failed[j] - failed;
+			return 0;
+		}
+	}
+
 	return 1;
 }
 
@@ -145,27 +169,239 @@ static int is_parity_matching(struct snapraid_state* state, unsigned diskmax, un
 	raid_gen(diskmax, i + 1, state->block_size, buffer);
 
 	/* if the recovered parity block matches */
-	if (memcmp(buffer[diskmax + i], buffer_recov[i], state->block_size) == 0) {
-		/* recompute all the redundancy information */
-		raid_gen(diskmax, state->level, state->block_size, buffer);
-		return 1;
+	return memcmp(buffer[diskmax + i], buffer_recov[i], state->block_size) == 0;
+}
+
+/**
+ * Try to recover the failed blocks with a combination of parities.
+ *
+ * With a hash, the first ::r parities in ip[] are used, and the result is checked with the hash.
+ * Without a hash, the first ::r - 1 parities are used, and the result is checked with the ip[r - 1] one.
+ *
+ * The recovered data is left in the buffer vector, but the parity is not recomputed.
+ * Return !=0 if the recovered data is verified, otherwise ::mismatch is set
+ * to the failed entry not matching the hash, or to -1.
+ */
+static int repair_attempt(struct snapraid_state* state, struct raid_cache* cache, int rehash, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero, int* id, int* ip, unsigned r, int has_hash, int* mismatch)
+{
+	unsigned i;
+
+	*mismatch = -1;
+
+	if (has_hash) {
+		/* copy the parities to use */
+		for (i = 0; i < r; ++i)
+			memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
+
+		/* recover */
+		raid_data_cache(cache, r, id, ip, diskmax, state->block_size, buffer);
+
+		/* use the hash to check the result */
+		return is_hash_matching(state, rehash, failed, failed_map, failed_count, buffer, buffer_zero, mismatch);
+	} else {
+		/* copy the parities to use, one less because the last is used for checking */
+		for (i = 0; i < r - 1; ++i)
+			memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
+
+		/* recover using one less parity, the ip[r-1] one */
+		raid_data_cache(cache, r - 1, id, ip, diskmax, state->block_size, buffer);
+
+		/* use the remaining ip[r-1] parity to check the result */
+		return is_parity_matching(state, diskmax, ip[r - 1], buffer, buffer_recov);
+	}
+}
+
+/**
+ * Log a failed recovering attempt.
+ */
+static void repair_attempt_log(unsigned pos, int* ip, unsigned r, int has_hash, int mismatch)
+{
+	unsigned i;
+
+	if (mismatch >= 0)
+		log_tag("hash_error: Hash mismatch on entry %d\n", mismatch);
+
+	log_tag("parity_error:%u:", pos);
+	for (i = 0; i < r; ++i) {
+		if (i != 0)
+			log_tag("/");
+		log_tag("%s", lev_config_name(ip[i]));
+	}
+	if (has_hash)
+		log_tag(":hash: Hash mismatch\n");
+	else
+		log_tag(":parity: Parity mismatch\n");
+}
+
+/**
+ * Max number of combinations of parities to try.
+ * It's the binomial coefficient of 3 of 6 parities.
+ */
+#define REPAIR_COMBO_MAX 20
+
+#if HAVE_THREAD
+/**
+ * Shared state of the workers trying the recovering combinations in parallel.
+ */
+struct repair_pool {
+	struct snapraid_state* state;
+	int rehash;
+	unsigned diskmax;
+	struct failed_struct* failed;
+	unsigned* failed_map;
+	unsigned failed_count;
+	void** buffer; /**< Buffers with the data read, only read by the workers. */
+	void** buffer_recov;
+	void* buffer_zero;
+	int* id;
+	unsigned r; /**< Number of parities in each combination. */
+	int has_hash;
+	int* combo; /**< Combinations to try, ::r parities each. */
+	int* combo_mismatch; /**< Entry not matching the hash for each combination tried. */
+	unsigned combo_max; /**< Number of combinations. */
+	unsigned combo_next; /**< Next combination to try. */
+	unsigned combo_best; /**< First verified combination, or ::combo_max if none. */
+	thread_mutex_t mutex;
+};
+
+/**
+ * Worker trying the recovering combinations.
+ */
+struct repair_worker {
+	struct repair_pool* pool;
+	thread_id_t thread;
+	void** buffer; /**< Private vector of buffers. Failed data and parity are private. */
+	void* buffer_alloc;
+	void** buffer_ptr;
+	struct raid_cache cache; /**< Private cache of inverted matrices. */
+	unsigned match; /**< Combination verified, or ::combo_max if none. */
+};
+
+static void* repair_worker_thread(void* arg)
+{
+	struct repair_worker* worker = arg;
+	struct repair_pool* pool = worker->pool;
+
+	while (1) {
+		unsigned c;
+
+		/* get the next combination to try */
+		thread_mutex_lock(&pool->mutex);
+		c = pool->combo_next++;
+		/* stop if a previous combination is already verified */
+		if (c >= pool->combo_best) {
+			thread_mutex_unlock(&pool->mutex);
+			break;
+		}
+		thread_mutex_unlock(&pool->mutex);
+
+		if (repair_attempt(pool->state, &worker->cache, pool->rehash, pool->diskmax, pool->failed, pool->failed_map, pool->failed_count, worker->buffer, pool->buffer_recov, pool->buffer_zero, pool->id, pool->combo + c * pool->r, pool->r, pool->has_hash, &pool->combo_mismatch[c])) {
+			thread_mutex_lock(&pool->mutex);
+			worker->match = c;
+			if (c < pool->combo_best)
+				pool->combo_best = c;
+			thread_mutex_unlock(&pool->mutex);
+
+			/* stop, keeping the recovered data in the buffers, */
+			/* as all the next combinations are after this one */
+			break;
+		}
 	}
 
 	return 0;
 }
 
+/**
+ * Try all the combinations in parallel, one worker for each parity level.
+ * Each worker has its own copy of the failed data and of the parity.
+ * Return the first verified combination, or combo_max if none,
+ * and if found, the recovered data is copied in the buffer vector.
+ */
+static unsigned repair_parallel(struct repair_pool* pool)
+{
+	struct snapraid_state* state = pool->state;
+	struct repair_worker* worker_map;
+	unsigned worker_max;
+	unsigned diskmax = pool->diskmax;
+	unsigned buffermax = pool->failed_count + state->level;
+	unsigned i, j;
+
+	worker_max = state->level;
+	if (worker_max > pool->combo_max)
+		worker_max = pool->combo_max;
+
+	pool->combo_next = 0;
+	pool->combo_best = pool->combo_max;
+	thread_mutex_init(&pool->mutex);
+
+	worker_map = malloc_nofail(worker_max * sizeof(struct repair_worker));
+	for (i = 0; i < worker_max; ++i) {
+		struct repair_worker* worker = &worker_map[i];
+
+		worker->pool = pool;
+		worker->match = pool->combo_max;
+		raid_cache_init(&worker->cache);
+		worker->buffer_ptr = malloc_nofail_vector_align(pool->failed_count, buffermax, state->block_size, &worker->buffer_alloc);
+		worker->buffer = malloc_nofail((diskmax + state->level) * sizeof(void*));
+
+		/* the not failed data is shared */
+		for (j = 0; j < diskmax; ++j)
+			worker->buffer[j] = pool->buffer[j];
+
+		/* the failed data and the parity are private */
+		for (j = 0; j < pool->failed_count; ++j)
+			worker->buffer[pool->id[j]] = worker->buffer_ptr[j];
+		for (j = 0; j < state->level; ++j)
+			worker->buffer[diskmax + j] = worker->buffer_ptr[pool->failed_count + j];
+
+		thread_create(&worker->thread, repair_worker_thread, worker);
+	}
+
+	for (i = 0; i < worker_max; ++i) {
+		void* retval;
+
+		thread_join(worker_map[i].thread, &retval);
+	}
+
+	thread_mutex_destroy(&pool->mutex);
+
+	/* copy the recovered data from the worker that verified the best combination */
+	for (i = 0; i < worker_max; ++i) {
+		struct repair_worker* worker = &worker_map[i];
+
+		if (worker->match == pool->combo_best) {
+			for (j = 0; j < pool->failed_count; ++j)
+				memcpy(pool->buffer[pool->id[j]], worker->buffer[pool->id[j]], state->block_size);
+		}
+	}
+
+	for (i = 0; i < worker_max; ++i) {
+		free(worker_map[i].buffer);
+		free(worker_map[i].buffer_ptr);
+		free(worker_map[i].buffer_alloc);
+	}
+	free(worker_map);
+
+	return pool->combo_best;
+}
+#endif
+
 /**
  * Repair errors.
  * Return <0 if failure for missing strategy, >0 if data is wrong and we cannot rebuild correctly, 0 on success.
  * If success, the parity are computed in the buffer variable.
  */
-static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
+static int repair_step(struct snapraid_state* state, struct raid_cache* cache, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
 {
-	unsigned i, n;
+	unsigned i, n, r, c;
 	int error;
 	int has_hash;
 	int id[LEV_MAX];
 	int ip[LEV_MAX];
+	int combo[LEV_MAX * REPAIR_COMBO_MAX];
+	int combo_mismatch[REPAIR_COMBO_MAX];
+	unsigned combo_max;
+	int mismatch;
 
 	/* no fix required, already checked at higher level, but just to be sure */
 	if (failed_count == 0) {
@@ -195,13 +431,23 @@ static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, u
 			has_hash = 1;
 	}
 
-	/* if we don't have a hash, but we have an extra parity */
-	/* (strictly-less failures than number of parities) */
 	if (!has_hash && failed_count < n) {
+		/* if we don't have a hash, but we have an extra parity */
+		/* (strictly-less failures than number of parities) */
 		/* number of parity to use, one more to check the recovering */
-		unsigned r = failed_count + 1;
+		r = failed_count + 1;
+	} else if (has_hash && failed_count <= n) {
+		/* if we have a hash, and enough parities */
+		/* (less-or-equal failures than number of parities) */
+		/* number of parities to use equal at the number of failures */
+		r = failed_count;
+	} else {
+		r = 0;
+	}
 
-		/* all combinations (r of n) parities */
+	/* collect all combinations (r of n) parities, skipping the ones with a missing parity */
+	combo_max = 0;
+	if (r != 0) {
 		combination_first(r, n, ip);
 		do {
 			/* if a parity is missing, do nothing */
@@ -212,67 +458,67 @@ static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, u
 			if (i != r)
 				continue;
 
-			/* copy the parities to use, one less because the last is used for checking */
-			for (i = 0; i < r - 1; ++i)
-				memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
-
-			/* recover using one less parity, the ip[r-1] one */
-			raid_data(r - 1, id, ip, diskmax, state->block_size, buffer);
-
-			/* use the remaining ip[r-1] parity to check the result */
-			if (is_parity_matching(state, diskmax, ip[r - 1], buffer, buffer_recov))
-				return 0;
-
-			/* log */
-			log_tag("parity_error:%u:", pos);
-			for (i = 0; i < r; ++i) {
-				if (i != 0)
-					log_tag("/");
-				log_tag("%s", lev_config_name(ip[i]));
-			}
-			log_tag(":parity: Parity mismatch\n");
-			++error;
+			memcpy(combo + combo_max * r, ip, r * sizeof(int));
+			++combo_max;
 		} while (combination_next(r, n, ip));
 	}
 
-	/* if we have a hash, and enough parities */
-	/* (less-or-equal failures than number of parities) */
-	if (has_hash && failed_count <= n) {
-		/* number of parities to use equal at the number of failures */
-		unsigned r = failed_count;
+	/* try the first combination, that is the one working */
+	/* if only the data is damaged */
+	c = 0;
+	if (combo_max != 0) {
+		if (repair_attempt(state, cache, rehash, diskmax, failed, failed_map, failed_count, buffer, buffer_recov, buffer_zero, id, combo, r, has_hash, &mismatch))
+			goto verified;
 
-		/* all combinations (r of n) parities */
-		combination_first(r, n, ip);
-		do {
-			/* if a parity is missing, do nothing */
-			for (i = 0; i < r; ++i) {
-				if (buffer_recov[ip[i]] == 0)
-					break;
-			}
-			if (i != r)
-				continue;
+		repair_attempt_log(pos, combo, r, has_hash, mismatch);
+		++error;
+		c = 1;
+	}
 
-			/* copy the parities to use */
-			for (i = 0; i < r; ++i)
-				memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
+#if HAVE_THREAD
+	/* try all the others in parallel, unless the io cache is disabled */
+	if (combo_max - c > 1 && state->opt.io_cache != 1) {
+		struct repair_pool pool;
+		unsigned best;
+
+		pool.state = state;
+		pool.rehash = rehash;
+		pool.diskmax = diskmax;
+		pool.failed = failed;
+		pool.failed_map = failed_map;
+		pool.failed_count = failed_count;
+		pool.buffer = buffer;
+		pool.buffer_recov = buffer_recov;
+		pool.buffer_zero = buffer_zero;
+		pool.id = id;
+		pool.r = r;
+		pool.has_hash = has_hash;
+		pool.combo = combo + c * r;
+		pool.combo_mismatch = combo_mismatch;
+		pool.combo_max = combo_max - c;
+
+		best = repair_parallel(&pool);
+
+		/* log the failed combinations tried before the verified one, in order */
+		for (i = 0; i < best; ++i) {
+			repair_attempt_log(pos, pool.combo + i * r, r, has_hash, combo_mismatch[i]);
+			++error;
+		}
 
-			/* recover */
-			raid_data(r, id, ip, diskmax, state->block_size, buffer);
+		if (best != pool.combo_max)
+			goto verified;
 
-			/* use the hash to check the result */
-			if (is_hash_matching(state, rehash, diskmax, failed, failed_map, failed_count, buffer, buffer_zero))
-				return 0;
+		c = combo_max;
+	}
+#endif
 
-			/* log */
-			log_tag("parity_error:%u:", pos);
-			for (i = 0; i < r; ++i) {
-				if (i != 0)
-					log_tag("/");
-				log_tag("%s", lev_config_name(ip[i]));
-			}
-			log_tag(":hash: Hash mismatch\n");
-			++error;
-		} while (combination_next(r, n, ip));
+	/* try all the others, one after the other */
+	for (; c < combo_max; ++c) {
+		if (repair_attempt(state, cache, rehash, diskmax, failed, failed_map, failed_count, buffer, buffer_recov, buffer_zero, id, combo + c * r, r, has_hash, &mismatch))
+			goto verified;
+
+		repair_attempt_log(pos, combo + c * r, r, has_hash, mismatch);
+		++error;
 	}
 
 	/* return the number of failed attempts, or -1 if no strategy */
@@ -282,9 +528,14 @@ static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, u
 	log_tag("strategy_error:%u: No strategy to recover from %u failures with %u parity %s hash\n",
 		pos, failed_count, n, has_hash ? "with" : "without");
 	return -1;
+
+verified:
+	/* recompute all the redundancy information */
+	raid_gen(diskmax, state->level, state->block_size, buffer);
+	return 0;
 }
 
-static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
+static int repair(struct snapraid_state* state, struct raid_cache* cache, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
 {
 	int ret;
 	int error;
@@ -396,7 +647,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 		return 0;
 	}
 
-	ret = repair_step(state, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
+	ret = repair_step(state, cache, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
 	if (ret == 0) {
 		/* reprocess the CHG blocks, for which we don't have a hash to check */
 		/* if they were BAD we have to use some heuristics to ensure that we have recovered  */
@@ -539,7 +790,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 	/* if nothing to fix, we just don't try */
 	/* if nothing unsynced we also don't retry, because it's the same try as before */
 	if (something_to_recover && something_unsynced) {
-		ret = repair_step(state, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
+		ret = repair_step(state, cache, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
 		if (ret == 0) {
 			/* reprocess the REP and CHG blocks, for which we have recovered and old state */
 			/* that we don't want to save into disk */
@@ -866,13 +1117,218 @@ static int block_is_enabled(struct snapraid_state* state, block_off_t i, struct
 	return 0;
 }
 
-static int state_check_process(struct snapraid_state* state, int fix, struct snapraid_parity_handle** parity, block_off_t blockstart, block_off_t blockmax)
+/**
+ * Check if only the files select the blocks to process.
+ *
+ * It happens when filtering files, without filtering for bad blocks,
+ * and with all the parities excluded, like with 'fix -f FILE'.
+ */
+static int block_is_enabled_only_by_file(struct snapraid_state* state)
+{
+	unsigned l;
+
+	if (state->opt.badblockonly || state->opt.badfileonly)
+		return 0;
+
+	for (l = 0; l < state->level; ++l) {
+		if (!state->parity[l].is_excluded_by_filter)
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Enable the blocks of all the files not excluded.
+ *
+ * It's the same selection of block_is_enabled() when block_is_enabled_only_by_file()
+ * is true, but it's proportional to the size of the selected files, and not to the
+ * size of the array. Return the number of blocks enabled.
+ */
+static block_off_t block_enable_by_file(bit_vect_t* block_enabled, block_off_t blockstart, block_off_t blockmax, struct snapraid_handle* handle, unsigned diskmax)
+{
+	block_off_t count;
+	unsigned j;
+
+	count = 0;
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_disk* disk = handle[j].disk;
+		tommy_node* node;
+
+		/* if no disk, nothing to check */
+		if (!disk)
+			continue;
+
+		for (node = disk->filelist; node != 0; node = node->next) {
+			struct snapraid_file* file = node->data;
+			block_off_t f;
+
+			/* only if the file is not filtered out */
+			if (file_flag_has(file, FILE_IS_EXCLUDED))
+				continue;
+
+			for (f = 0; f < file->blockmax; ++f) {
+				block_off_t parity_pos = fs_file2par_get(disk, file, f);
+
+				if (parity_pos < blockstart || parity_pos >= blockmax)
+					continue;
+
+				/* the same position may be shared with other disks */
+				if (!bit_vect_test(block_enabled, parity_pos)) {
+					bit_vect_set(block_enabled, parity_pos);
+					++count;
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Ignore the messages.
+ */
+static void log_ignore(const char* format, ...)
+{
+	(void)format;
+}
+
+/**
+ * Read a data block for check and fix.
+ *
+ * The worker uses its own handles, different than the ones used by the
+ * main thread to create, truncate and write the files, because it may be
+ * already reading the next blocks. Errors are not reported here, as the
+ * main thread reads again the failed blocks with its handles, and reports them.
+ */
+static void check_data_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_state* state = io->state;
+	struct snapraid_handle* handle = worker->handle;
+	struct snapraid_disk* disk = handle->disk;
+	block_off_t blockcur = task->position;
+	unsigned char* buffer = task->buffer;
+	int ret;
+	char esc_buffer[ESC_MAX];
+
+	/* if the disk position is not used */
+	if (!disk) {
+		/* use an empty block */
+		memset(buffer, 0, state->block_size);
+		task->state = TASK_STATE_DONE;
+		return;
+	}
+
+	/* get the block */
+	task->block = fs_par2block_find(disk, blockcur);
+
+	/* if the block is not used */
+	if (!block_has_file(task->block)) {
+		/* use an empty block */
+		memset(buffer, 0, state->block_size);
+		task->state = TASK_STATE_DONE;
+		return;
+	}
+
+	/* get the file of this block */
+	task->file = fs_par2file_get(disk, blockcur, &task->file_pos);
+
+	/* if the file is different than the current one, close it */
+	if (handle->file != 0 && handle->file != task->file) {
+		/* keep a pointer at the file we are going to close for error reporting */
+		struct snapraid_file* report = handle->file;
+		ret = handle_close(handle);
+		if (ret == -1) {
+			/* LCOV_EXCL_START */
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc_tag(report->sub, esc_buffer), strerror(errno));
+			log_fatal("DANGER! Unexpected close error in a data disk.\n");
+			log_fatal("Stopping at block %u\n", blockcur);
+			task->state = TASK_STATE_ERROR;
+			return;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	/* if the file was missing, don't retry to open it, as the main thread may have created it */
+	/* note that the first open of the file in the worker is always before the main thread */
+	/* can create it, as the main thread processes the block only after the worker read it */
+	if (file_reader_flag_has(task->file, FILE_IS_MISSING)) {
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	ret = handle_open(handle, task->file, state->file_mode, log_ignore, 0);
+	if (ret == -1) {
+		if (errno == ENOENT)
+			file_reader_flag_set(task->file, FILE_IS_MISSING);
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	task->read_size = handle_read(handle, task->file_pos, buffer, state->block_size, log_ignore, 0);
+	if (task->read_size == -1) {
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	/* close the file after its last block, as the main thread may rename it */
+	if (file_block_is_last(task->file, task->file_pos)) {
+		ret = handle_close(handle);
+		if (ret == -1) {
+			/* LCOV_EXCL_START */
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc_tag(task->file->sub, esc_buffer), strerror(errno));
+			log_fatal("DANGER! Unexpected close error in a data disk.\n");
+			log_fatal("Stopping at block %u\n", blockcur);
+			task->state = TASK_STATE_ERROR;
+			return;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	task->state = TASK_STATE_DONE;
+}
+
+/**
+ * Read a parity block for check and fix.
+ *
+ * Parities not accessible are marked with no split, and they are
+ * just skipped, as the main thread already knows it.
+ */
+static void check_parity_reader(struct snapraid_worker* worker, struct snapraid_task* task)
 {
+	struct snapraid_parity_handle* parity_handle = worker->parity_handle;
+	struct snapraid_io* io = worker->io;
+	struct snapraid_state* state = io->state;
+	int ret;
+
+	if (parity_handle->split_mac == 0) {
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	ret = parity_read(parity_handle, task->position, task->buffer, state->block_size, log_error);
+	if (ret == -1) {
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	task->state = TASK_STATE_DONE;
+}
+
+static int state_check_process(struct snapraid_state* state, int fix, struct snapraid_parity_handle* parity_handle, struct snapraid_parity_handle** parity, block_off_t blockstart, block_off_t blockmax)
+{
+	struct snapraid_io io;
+	struct snapraid_handle* read_handle;
+	struct snapraid_task** task_map;
+	unsigned* waiting_map;
+	unsigned waiting_mac;
+	void* buffer_zero_alloc;
+	void* buffer_zero;
 	struct snapraid_handle* handle;
 	unsigned diskmax;
 	block_off_t i;
 	unsigned j;
-	void* buffer_alloc;
 	void** buffer;
 	unsigned buffermax;
 	int ret;
@@ -888,19 +1344,33 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	char esc_buffer[ESC_MAX];
 	char esc_buffer_alt[ESC_MAX];
 	bit_vect_t* block_enabled;
+	int parity_mask;
+	struct raid_cache cache;
 
+	/* the main thread and the workers use different handles */
 	handle = handle_mapping(state, &diskmax);
+	read_handle = handle_mapping(state, &diskmax);
+
+	/* we need 1 * data + 2 * parity */
+	buffermax = diskmax + 2 * state->level;
+
+	/* initialize the io threads, without parity if not checking it */
+	io_init(&io, state, state->opt.io_cache, buffermax, check_data_reader, read_handle, diskmax, check_parity_reader, 0, parity_handle, state->opt.auditonly ? 0 : state->level);
 
-	/* we need 1 * data + 2 * parity + 1 * zero */
-	buffermax = diskmax + 2 * state->level + 1;
+	/* possibly waiting disks */
+	waiting_mac = diskmax > RAID_PARITY_MAX ? diskmax : RAID_PARITY_MAX;
+	waiting_map = malloc_nofail(waiting_mac * sizeof(unsigned));
 
-	buffer = malloc_nofail_vector_align(diskmax, buffermax, state->block_size, &buffer_alloc);
-	if (!state->opt.skip_self)
-		mtest_vector(buffermax, state->block_size, buffer);
+	/* tasks of the data disks, ordered by disk */
+	task_map = malloc_nofail(diskmax * sizeof(struct snapraid_task*));
 
 	/* fill up the zero buffer */
-	memset(buffer[buffermax - 1], 0, state->block_size);
-	raid_zero(buffer[buffermax - 1]);
+	buffer_zero = malloc_nofail_align(state->block_size, &buffer_zero_alloc);
+	memset(buffer_zero, 0, state->block_size);
+	raid_zero(buffer_zero);
+
+	/* the same failures are usually repaired in many blocks */
+	raid_cache_init(&cache);
 
 	failed = malloc_nofail(diskmax * sizeof(struct failed_struct));
 	failed_map = malloc_nofail(diskmax * sizeof(unsigned));
@@ -914,11 +1384,16 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	/* first count the number of blocks to process */
 	countmax = 0;
 	block_enabled = calloc_nofail(1, bit_vect_size(blockmax)); /* preinitialize to 0 */
-	for (i = blockstart; i < blockmax; ++i) {
-		if (!block_is_enabled(state, i, handle, diskmax))
-			continue;
-		bit_vect_set(block_enabled, i);
-		++countmax;
+	if (block_is_enabled_only_by_file(state)) {
+		/* get the positions directly from the files */
+		countmax = block_enable_by_file(block_enabled, blockstart, blockmax, handle, diskmax);
+	} else {
+		for (i = blockstart; i < blockmax; ++i) {
+			if (!block_is_enabled(state, i, handle, diskmax))
+				continue;
+			bit_vect_set(block_enabled, i);
+			++countmax;
+		}
 	}
 
 	if (fix)
@@ -931,17 +1406,38 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	/* check all the blocks in files */
 	countsize = 0;
 	countpos = 0;
+
+	/* start all the worker threads */
+	io_start(&io, blockstart, blockmax, block_enabled);
+
 	state_progress_begin(state, blockstart, blockmax, countmax);
-	for (i = blockstart; i < blockmax; ++i) {
+	while (1) {
 		unsigned failed_count;
 		int valid_parity;
 		int used_parity;
 		snapraid_info info;
 		int rehash;
 
-		if (!bit_vect_test(block_enabled, i)) {
-			/* continue with the next block */
-			continue;
+		/* go to the next block */
+		i = io_read_next(&io, &buffer);
+		if (i >= blockmax)
+			break;
+
+		/* wait for all the data blocks, and process them in disk order */
+		for (j = 0; j < diskmax; ++j) {
+			struct snapraid_task* task;
+			unsigned diskcur;
+
+			task = io_data_read(&io, &diskcur, waiting_map, &waiting_mac);
+
+			if (task->state == TASK_STATE_ERROR) {
+				/* LCOV_EXCL_START */
+				++unrecoverable_error;
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+
+			task_map[diskcur] = task;
 		}
 
 		/* If we have valid parity, and it makes sense to check its content. */
@@ -1070,6 +1566,10 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 						/* if fragmented, it may be reopened, so remember that the file */
 						/* was originally missing */
 						file_flag_set(file, FILE_IS_CREATED);
+
+						/* allocate the whole file before writing it, as when rebuilding */
+						/* a full disk all its files are written block after block */
+						handle_allocate(&handle[j], file, state->opt.skip_fallocate);
 					}
 				} else {
 					/* open the file only for reading */
@@ -1148,9 +1648,15 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 				file_flag_set(file, FILE_IS_OPENED);
 			}
 
-			/* read from the file */
-			read_size = handle_read(&handle[j], file_pos, buffer[j], state->block_size,
-				log_error, state->opt.expected_missing ? log_expected : 0);
+			/* get the data read by the worker */
+			/* if the worker failed, or the file was created by the fix, read it again with */
+			/* the handle of the main thread, as the worker may have read it before or after */
+			/* its creation, and only the main thread knows what was already written */
+			if (task_map[j]->state == TASK_STATE_DONE && !file_flag_has(file, FILE_IS_CREATED))
+				read_size = task_map[j]->read_size;
+			else
+				read_size = handle_read(&handle[j], file_pos, buffer[j], state->block_size,
+					log_error, state->opt.expected_missing ? log_expected : 0);
 			if (read_size == -1) {
 				/* save the failed block for the check/fix */
 				failed[failed_count].is_bad = 1; /* it's bad because we cannot read it */
@@ -1237,7 +1743,6 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 		/* now read and check the parity if requested */
 		if (!state->opt.auditonly) {
 			void* buffer_recov[LEV_MAX];
-			void* buffer_zero;
 
 			/* buffers for parity read and not computed */
 			for (l = 0; l < state->level; ++l)
@@ -1245,26 +1750,51 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 			for (; l < LEV_MAX; ++l)
 				buffer_recov[l] = 0;
 
-			/* the zero buffer is the last one */
-			buffer_zero = buffer[buffermax - 1];
-
 			/* read the parity */
 			for (l = 0; l < state->level; ++l) {
-				if (parity[l]) {
-					ret = parity_read(parity[l], i, buffer_recov[l], state->block_size, log_error);
-					if (ret == -1) {
-						buffer_recov[l] = 0; /* no parity to use */
+				struct snapraid_task* task;
+				unsigned levcur;
+
+				task = io_parity_read(&io, &levcur, waiting_map, &waiting_mac);
 
-						log_tag("parity_error:%u:%s: Read error\n", i, lev_config_name(l));
+				if (parity[levcur]) {
+					if (task->state != TASK_STATE_DONE) {
+						buffer_recov[levcur] = 0; /* no parity to use */
+
+						log_tag("parity_error:%u:%s: Read error\n", i, lev_config_name(levcur));
 						++error;
 					}
 				} else {
-					buffer_recov[l] = 0;
+					buffer_recov[levcur] = 0;
 				}
 			}
 
-			/* try all the recovering strategies */
-			ret = repair(state, rehash, i, diskmax, failed, failed_map, failed_count, buffer, buffer_recov, buffer_zero);
+			/* by default compare all the parity levels */
+			parity_mask = ~0;
+
+			if (failed_count == 0 && used_parity && valid_parity) {
+				int parity_missing = 0;
+
+				/* nothing to recover, so verify the parity read without computing it in full */
+				parity_mask = raid_gen_verify(diskmax, state->level, state->block_size, buffer);
+
+				/* ignore the levels without parity, as their buffer contains garbage */
+				for (l = 0; l < state->level; ++l) {
+					if (buffer_recov[l] == 0) {
+						parity_mask &= ~(1 << l);
+						parity_missing = 1;
+					}
+				}
+
+				/* the computed parity is needed to report the differences and to fix it */
+				if (parity_mask != 0 || parity_missing)
+					raid_gen(diskmax, state->level, state->block_size, buffer);
+
+				ret = 0;
+			} else {
+				/* try all the recovering strategies */
+				ret = repair(state, &cache, rehash, i, diskmax, failed, failed_map, failed_count, buffer, buffer_recov, buffer_zero);
+			}
 			if (ret != 0) {
 				/* increment the number of errors */
 				if (ret > 0)
@@ -1312,7 +1842,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 				if (used_parity && valid_parity) {
 					/* check the parity */
 					for (l = 0; l < state->level; ++l) {
-						if (buffer_recov[l] != 0 && memcmp(buffer_recov[l], buffer[diskmax + l], state->block_size) != 0) {
+						if (buffer_recov[l] != 0 && (parity_mask & (1 << l)) != 0 && memcmp(buffer_recov[l], buffer[diskmax + l], state->block_size) != 0) {
 							unsigned diff = memdiff(buffer_recov[l], buffer[diskmax + l], state->block_size);
 
 							/* mark that the read parity is wrong, setting ptr to 0 */
@@ -1440,7 +1970,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 		++countpos;
 
 		/* progress */
-		if (state_progress(state, 0, i, countpos, countmax, countsize)) {
+		if (state_progress(state, &io, i, countpos, countmax, countsize)) {
 			/* LCOV_EXCL_START */
 			break;
 			/* LCOV_EXCL_STOP */
@@ -1808,6 +2338,9 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	state_progress_end(state, countpos, countmax, countsize);
 
 bail:
+	/* stop all the worker threads */
+	io_stop(&io);
+
 	/* close all the files left open */
 	for (j = 0; j < diskmax; ++j) {
 		struct snapraid_file* file = handle[j].file;
@@ -1822,6 +2355,19 @@ bail:
 			/* LCOV_EXCL_STOP */
 		}
 	}
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_file* file = read_handle[j].file;
+		struct snapraid_disk* disk = read_handle[j].disk;
+		ret = handle_close(&read_handle[j]);
+		if (ret == -1) {
+			/* LCOV_EXCL_START */
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockmax, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
+			log_fatal("DANGER! Unexpected close error in a data disk.\n");
+			++unrecoverable_error;
+			/* continue, as we are already exiting */
+			/* LCOV_EXCL_STOP */
+		}
+	}
 
 	/* remove all the files created from scratch that have not finished the processing */
 	/* it happens only when aborting pressing Ctrl+C or other reason. */
@@ -1929,8 +2475,11 @@ bail:
 	free(failed_map);
 	free(block_enabled);
 	free(handle);
-	free(buffer_alloc);
-	free(buffer);
+	free(read_handle);
+	free(task_map);
+	free(waiting_map);
+	free(buffer_zero_alloc);
+	io_done(&io);
 
 	/* fail if some error are present after the run */
 	if (fix) {
@@ -1964,6 +2513,8 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 	int ret;
 	struct snapraid_parity_handle parity[LEV_MAX];
 	struct snapraid_parity_handle* parity_ptr[LEV_MAX];
+	struct snapraid_parity_handle parity_reader[LEV_MAX];
+	struct snapraid_parity_handle* parity_reader_ptr[LEV_MAX];
 	unsigned error;
 	unsigned l;
 
@@ -1988,6 +2539,10 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 		/* if fixing, create the file and open for writing */
 		/* if it fails, we cannot continue */
 		for (l = 0; l < state->level; ++l) {
+			/* by default the readers have no parity to read */
+			parity_reader[l].split_mac = 0;
+			parity_reader_ptr[l] = 0;
+
 			/* skip parity disks that are not accessible */
 			if (state->parity[l].skip_access) {
 				parity_ptr[l] = 0;
@@ -2003,6 +2558,7 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 				if (ret == -1) {
 					/* continue anyway */
 					parity_ptr[l] = 0;
+					continue;
 				}
 			} else {
 				/* open for writing */
@@ -2013,7 +2569,20 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 					exit(EXIT_FAILURE);
 					/* LCOV_EXCL_STOP */
 				}
+			}
+
+			/* the readers use a different handle, as the main thread writes the fixed parity */
+			/* open it before resizing, to see the same valid data of the main handle */
+			ret = parity_open(&parity_reader[l], &state->parity[l], l, state->file_mode, state->block_size, state->opt.parity_limit_size);
+			if (ret == -1) {
+				/* LCOV_EXCL_START */
+				log_fatal("WARNING! Without an accessible %s file, it isn't possible to fix any error.\n", lev_name(l));
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			parity_reader_ptr[l] = &parity_reader[l];
 
+			if (!state->parity[l].is_excluded_by_filter) {
 				ret = parity_chsize(parity_ptr[l], &state->parity[l], 0, size, state->block_size, state->opt.skip_fallocate, state->opt.skip_space_holder);
 				if (ret == -1) {
 					/* LCOV_EXCL_START */
@@ -2032,6 +2601,7 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 			if (ret == -1) {
 				msg_status("No accessible %s file, only files will be checked.\n", lev_name(l));
 				/* continue anyway */
+				parity[l].split_mac = 0; /* mark it as not accessible for the readers */
 				parity_ptr[l] = 0;
 			}
 		}
@@ -2045,7 +2615,8 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 
 	/* skip degenerated cases of empty parity, or skipping all */
 	if (blockstart < blockmax) {
-		ret = state_check_process(state, fix, parity_ptr, blockstart, blockmax);
+		/* when checking, the main thread doesn't access the parity, and the readers can use its handles */
+		ret = state_check_process(state, fix, fix ? parity_reader : parity, parity_ptr, blockstart, blockmax);
 		if (ret == -1) {
 			/* LCOV_EXCL_START */
 			++error;
@@ -2054,6 +2625,22 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 		}
 	}
 
+	/* close the handles of the readers, only present when fixing */
+	if (fix) {
+		for (l = 0; l < state->level; ++l) {
+			if (parity_reader_ptr[l]) {
+				ret = parity_close(parity_reader_ptr[l]);
+				if (ret == -1) {
+					/* LCOV_EXCL_START */
+					log_fatal("DANGER! Unexpected close error in %s disk.\n", lev_name(l));
+					++error;
+					/* continue, as we are already exiting */
+					/* LCOV_EXCL_STOP */
+				}
+			}
+		}
+	}
+
 	/* try to close only if opened */
 	for (l = 0; l < state->level; ++l) {
 		if (parity_ptr[l]) {
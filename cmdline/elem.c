@@ -317,7 +317,7 @@ int filter_existence(int filter_missing, const char* dir, const char* sub)
 	return 1;
 }
 
-int filter_correctness(int filter_error, tommy_arrayblkof* infoarr, struct snapraid_disk* disk, struct snapraid_file* file)
+int filter_correctness(int filter_error, struct snapraid_infoarr* infoarr, struct snapraid_disk* disk, struct snapraid_file* file)
 {
 	unsigned i;
 
@@ -358,6 +358,14 @@ int filter_content(tommy_list* contentlist, const char* path)
 		pathprint(tmp, sizeof(tmp), "%s.lock", content->content);
 		if (pathcmp(tmp, path) == 0)
 			return -1;
+
+		/* exclude also the ".import" cache and its ".tmp" copy */
+		pathprint(tmp, sizeof(tmp), "%s.import", content->content);
+		if (pathcmp(tmp, path) == 0)
+			return -1;
+		pathprint(tmp, sizeof(tmp), "%s.import.tmp", content->content);
+		if (pathcmp(tmp, path) == 0)
+			return -1;
 	}
 
 	return 0;
@@ -377,6 +385,7 @@ struct snapraid_file* file_alloc(unsigned block_size, const char* sub, data_off_
 	file->inode = inode;
 	file->physical = physical;
 	file->flag = 0;
+	file->reader_flag = 0;
 	file->blockvec = malloc_nofail(file->blockmax * block_sizeof());
 
 	for (i = 0; i < file->blockmax; ++i) {
@@ -402,6 +411,7 @@ struct snapraid_file* file_dup(struct snapraid_file* copy)
 	file->inode = copy->inode;
 	file->physical = copy->physical;
 	file->flag = copy->flag;
+	file->reader_flag = 0;
 	file->blockvec = malloc_nofail(file->blockmax * block_sizeof());
 
 	for (i = 0; i < file->blockmax; ++i) {
@@ -1422,18 +1432,256 @@ void map_free(struct snapraid_map* map)
 	free(map);
 }
 
-int time_compare(const void* void_a, const void* void_b)
+/****************************************************************************/
+/* info */
+
+void info_init(struct snapraid_infoarr* array)
+{
+	array->chunk = 0;
+	array->chunk_max = 0;
+}
+
+void info_done(struct snapraid_infoarr* array)
+{
+	block_off_t i;
+
+	for (i = 0; i < array->chunk_max; ++i)
+		free(array->chunk[i].map);
+	free(array->chunk);
+}
+
+void info_grow(struct snapraid_infoarr* array, block_off_t size)
+{
+	struct snapraid_infochunk* chunk;
+	block_off_t chunk_max;
+
+	chunk_max = ((uint64_t)size + INFO_CHUNK - 1) >> INFO_CHUNK_BIT;
+	if (chunk_max <= array->chunk_max)
+		return;
+
+	/* grow at least the double, to amortize the copy */
+	if (chunk_max < array->chunk_max * 2)
+		chunk_max = array->chunk_max * 2;
+
+	chunk = calloc_nofail(chunk_max, sizeof(struct snapraid_infochunk));
+	if (array->chunk_max)
+		memcpy(chunk, array->chunk, array->chunk_max * sizeof(struct snapraid_infochunk));
+	free(array->chunk);
+
+	array->chunk = chunk;
+	array->chunk_max = chunk_max;
+}
+
+void info_expand(struct snapraid_infoarr* array, block_off_t pos)
+{
+	struct snapraid_infochunk* chunk;
+	unsigned i;
+
+	info_grow(array, pos + 1);
+
+	chunk = &array->chunk[pos >> INFO_CHUNK_BIT];
+	if (chunk->map != 0)
+		return;
+
+	chunk->map = malloc_nofail(INFO_CHUNK * sizeof(snapraid_info));
+	for (i = 0; i < INFO_CHUNK; ++i)
+		chunk->map[i] = chunk->info;
+}
+
+void info_compact(struct snapraid_infoarr* array)
+{
+	block_off_t i;
+
+	for (i = 0; i < array->chunk_max; ++i) {
+		struct snapraid_infochunk* chunk = &array->chunk[i];
+		unsigned j;
+
+		if (chunk->map == 0)
+			continue;
+
+		for (j = 1; j < INFO_CHUNK; ++j)
+			if (chunk->map[j] != chunk->map[0])
+				break;
+
+		/* if all the same, collapse it */
+		if (j == INFO_CHUNK) {
+			chunk->info = chunk->map[0];
+			free(chunk->map);
+			chunk->map = 0;
+		}
+	}
+}
+
+void info_set_range(struct snapraid_infoarr* array, block_off_t begin, block_off_t end, snapraid_info info)
 {
-	const time_t* time_a = void_a;
-	const time_t* time_b = void_b;
+	if (begin >= end)
+		return;
+
+	info_grow(array, end);
+
+	while (begin < end) {
+		struct snapraid_infochunk* chunk = &array->chunk[begin >> INFO_CHUNK_BIT];
+		block_off_t chunk_end = (begin | (INFO_CHUNK - 1)) + 1;
+
+		if ((begin & (INFO_CHUNK - 1)) == 0 && chunk_end <= end) {
+			/* the whole chunk has the same info */
+			free(chunk->map);
+			chunk->map = 0;
+			chunk->info = info;
+			begin = chunk_end;
+		} else {
+			/* only a part of the chunk */
+			if (chunk_end > end)
+				chunk_end = end;
+			while (begin < chunk_end) {
+				info_set(array, begin, info);
+				++begin;
+			}
+		}
+	}
+}
+
+snapraid_info info_get_run(struct snapraid_infoarr* array, block_off_t pos, block_off_t end, block_off_t* run)
+{
+	snapraid_info info;
+	block_off_t i;
+
+	info = info_get(array, pos);
 
-	if (*time_a < *time_b)
+	i = pos + 1;
+	while (i < end) {
+		block_off_t chunk_end = (i | (INFO_CHUNK - 1)) + 1;
+		struct snapraid_infochunk* chunk;
+
+		if (chunk_end > end)
+			chunk_end = end;
+
+		/* positions after the allocated chunks have info 0 */
+		if ((i >> INFO_CHUNK_BIT) >= array->chunk_max) {
+			if (info != 0)
+				break;
+			i = end;
+			break;
+		}
+
+		chunk = &array->chunk[i >> INFO_CHUNK_BIT];
+
+		if (chunk->map == 0) {
+			/* skip the whole chunk if it has the same info */
+			if (chunk->info != info)
+				break;
+			i = chunk_end;
+		} else {
+			while (i < chunk_end && chunk->map[i & (INFO_CHUNK - 1)] == info)
+				++i;
+			if (i < chunk_end)
+				break;
+		}
+	}
+
+	*run = i - pos;
+
+	return info;
+}
+
+/****************************************************************************/
+/* time histogram */
+
+static int timecount_compare_to_arg(const void* void_arg, const void* void_data)
+{
+	const time_t* arg = void_arg;
+	const struct snapraid_timecount* data = void_data;
+
+	return *arg != data->time;
+}
+
+static int timecount_compare(const void* void_a, const void* void_b)
+{
+	const struct snapraid_timecount* const* a = void_a;
+	const struct snapraid_timecount* const* b = void_b;
+
+	if ((*a)->time < (*b)->time)
 		return -1;
-	if (*time_a > *time_b)
+	if ((*a)->time > (*b)->time)
 		return 1;
 	return 0;
 }
 
+static inline tommy_uint32_t timecount_hash(time_t time)
+{
+	return tommy_inthash_u64((uint64_t)time);
+}
+
+void timehist_init(struct snapraid_timehist* hist)
+{
+	tommy_hashdyn_init(&hist->set);
+	hist->last = 0;
+	hist->map = 0;
+	hist->map_max = 0;
+	hist->count = 0;
+}
+
+void timehist_done(struct snapraid_timehist* hist)
+{
+	tommy_hashdyn_foreach(&hist->set, free);
+	tommy_hashdyn_done(&hist->set);
+	free(hist->map);
+}
+
+void timehist_insert(struct snapraid_timehist* hist, time_t time, block_off_t count)
+{
+	struct snapraid_timecount* entry;
+
+	hist->count += count;
+
+	entry = hist->last;
+	if (entry == 0 || entry->time != time) {
+		entry = tommy_hashdyn_search(&hist->set, timecount_compare_to_arg, &time, timecount_hash(time));
+		if (entry == 0) {
+			entry = malloc_nofail(sizeof(struct snapraid_timecount));
+			entry->time = time;
+			entry->count = 0;
+			tommy_hashdyn_insert(&hist->set, &entry->node, entry, timecount_hash(time));
+		}
+		hist->last = entry;
+	}
+
+	entry->count += count;
+}
+
+static void timehist_map(void* void_arg, void* void_obj)
+{
+	struct snapraid_timehist* hist = void_arg;
+
+	hist->map[hist->map_max++] = void_obj;
+}
+
+void timehist_sort(struct snapraid_timehist* hist)
+{
+	hist->map = malloc_nofail(tommy_hashdyn_count(&hist->set) * sizeof(struct snapraid_timecount*));
+	hist->map_max = 0;
+
+	tommy_hashdyn_foreach_arg(&hist->set, timehist_map, hist);
+
+	qsort(hist->map, hist->map_max, sizeof(struct snapraid_timecount*), timecount_compare);
+}
+
+time_t timehist_at(struct snapraid_timehist* hist, block_off_t pos)
+{
+	unsigned i;
+
+	for (i = 0; i < hist->map_max; ++i) {
+		if (pos < hist->map[i]->count)
+			return hist->map[i]->time;
+		pos -= hist->map[i]->count;
+	}
+
+	/* LCOV_EXCL_START */
+	log_fatal("Internal inconsistency: Time histogram position %u out of range\n", pos);
+	os_abort();
+	/* LCOV_EXCL_STOP */
+}
+
 /****************************************************************************/
 /* format */
 
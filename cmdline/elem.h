@@ -275,6 +275,7 @@ struct snapraid_file {
 	int mtime_nsec; /**< Modification time nanoseconds. In the range 0 <= x < 1,000,000,000, or STAT_NSEC_INVALID if not present. */
 	block_off_t blockmax; /**< Number of blocks. */
 	unsigned flag; /**< FILE_IS_* flags. */
+	unsigned reader_flag; /**< FILE_IS_* flags used only by the reader thread of the disk, apart to not race with the main thread. */
 	char* sub; /**< Sub path of the file. Without the disk dir. The disk is implicit. */
 
 	/* nodes for data structures */
@@ -485,6 +486,37 @@ struct snapraid_parity {
  */
 typedef uint32_t snapraid_info;
 
+/**
+ * Number of bits of positions in a chunk of the info array.
+ */
+#define INFO_CHUNK_BIT 16
+
+/**
+ * Number of positions in a chunk of the info array.
+ */
+#define INFO_CHUNK (1U << INFO_CHUNK_BIT)
+
+/**
+ * Chunk of positions of the info array.
+ */
+struct snapraid_infochunk {
+	snapraid_info info; /**< Info of all the positions. Valid only if ::map is 0. */
+	snapraid_info* map; /**< Info of each position, or 0 if all have the same ::info. */
+};
+
+/**
+ * Array of info for each parity position.
+ *
+ * Positions synced or scrubbed together share the same info, so the array
+ * is split in chunks, and a chunk with all the same info doesn't allocate
+ * the info of each position. A chunk is expanded at the first different info
+ * written, and collapsed again by info_compact().
+ */
+struct snapraid_infoarr {
+	struct snapraid_infochunk* chunk; /**< Vector of chunks. */
+	block_off_t chunk_max; /**< Number of chunks allocated. */
+};
+
 /**
  * Allocate a content.
  */
@@ -546,7 +578,7 @@ int filter_existence(int filter_missing, const char* dir, const char* sub);
  * Filter a file if bad.
  * Return !=0 if the file is correct and it should be excluded.
  */
-int filter_correctness(int filter_error, tommy_arrayblkof* infoarr, struct snapraid_disk* disk, struct snapraid_file* file);
+int filter_correctness(int filter_error, struct snapraid_infoarr* infoarr, struct snapraid_disk* disk, struct snapraid_file* file);
 
 /**
  * Filter a dir using a list of filters.
@@ -751,6 +783,16 @@ static inline void file_flag_clear(struct snapraid_file* file, unsigned mask)
 	file->flag &= ~mask;
 }
 
+static inline int file_reader_flag_has(const struct snapraid_file* file, unsigned mask)
+{
+	return (file->reader_flag & mask) == mask;
+}
+
+static inline void file_reader_flag_set(struct snapraid_file* file, unsigned mask)
+{
+	file->reader_flag |= mask;
+}
+
 /**
  * Allocate a file.
  */
@@ -1192,37 +1234,145 @@ static inline snapraid_info info_set_rehash(snapraid_info info)
 	return info | 0x2;
 }
 
+/**
+ * Initialize an empty info array.
+ */
+void info_init(struct snapraid_infoarr* array);
+
+/**
+ * Deinitialize the info array.
+ */
+void info_done(struct snapraid_infoarr* array);
+
+/**
+ * Allocate the chunks for all the positions up to the specified size.
+ * New positions have info 0.
+ */
+void info_grow(struct snapraid_infoarr* array, block_off_t size);
+
+/**
+ * Expand the chunk of the specified position to have an info for each position.
+ * After that, an info_set() in the chunk never reallocates it until the next info_compact().
+ */
+void info_expand(struct snapraid_infoarr* array, block_off_t pos);
+
+/**
+ * Collapse all the expanded chunks that have the same info in all the positions.
+ * It must not be called while other threads are reading the array.
+ */
+void info_compact(struct snapraid_infoarr* array);
+
+/**
+ * Set the same info in the range of positions [begin, end).
+ * Chunks fully inside the range are collapsed.
+ */
+void info_set_range(struct snapraid_infoarr* array, block_off_t begin, block_off_t end, snapraid_info info);
+
+/**
+ * Get the info at the specified position, and the number of consecutive
+ * positions, starting from it and up to ::end, that have the same info.
+ */
+snapraid_info info_get_run(struct snapraid_infoarr* array, block_off_t pos, block_off_t end, block_off_t* run);
+
 /**
  * Set the info at the specified position.
  * The position is allocated if not yet done.
  */
-static inline void info_set(tommy_arrayblkof* array, block_off_t pos, snapraid_info info)
+static inline void info_set(struct snapraid_infoarr* array, block_off_t pos, snapraid_info info)
 {
-	tommy_arrayblkof_grow(array, pos + 1);
+	struct snapraid_infochunk* chunk;
+
+	if ((pos >> INFO_CHUNK_BIT) >= array->chunk_max)
+		info_grow(array, pos + 1);
+
+	chunk = &array->chunk[pos >> INFO_CHUNK_BIT];
+
+	if (chunk->map == 0) {
+		/* nothing to do if the info is the same */
+		if (chunk->info == info)
+			return;
+
+		info_expand(array, pos);
+	}
 
-	memcpy(tommy_arrayblkof_ref(array, pos), &info, sizeof(snapraid_info));
+	chunk->map[pos & (INFO_CHUNK - 1)] = info;
 }
 
 /**
  * Get the info at the specified position.
  * For not allocated position, 0 is returned.
  */
-static inline snapraid_info info_get(tommy_arrayblkof* array, block_off_t pos)
+static inline snapraid_info info_get(struct snapraid_infoarr* array, block_off_t pos)
 {
-	snapraid_info info;
+	struct snapraid_infochunk* chunk;
 
-	if (pos >= tommy_arrayblkof_size(array))
+	if ((pos >> INFO_CHUNK_BIT) >= array->chunk_max)
 		return 0;
 
-	memcpy(&info, tommy_arrayblkof_ref(array, pos), sizeof(snapraid_info));
+	chunk = &array->chunk[pos >> INFO_CHUNK_BIT];
 
-	return info;
+	if (chunk->map == 0)
+		return chunk->info;
+
+	return chunk->map[pos & (INFO_CHUNK - 1)];
 }
 
+/****************************************************************************/
+/* time histogram */
+
+/**
+ * Number of blocks with the same time.
+ */
+struct snapraid_timecount {
+	time_t time; /**< Time of the blocks. */
+	block_off_t count; /**< Number of blocks with this time. */
+
+	/* nodes for data structures */
+	tommy_hashdyn_node node;
+};
+
+/**
+ * Histogram of block times.
+ *
+ * Every sync and scrub run assigns the same time at all the blocks it
+ * processes, so the number of different times is the number of runs,
+ * and not the number of blocks. This allows to get the sorted times
+ * without sorting all the blocks.
+ */
+struct snapraid_timehist {
+	tommy_hashdyn set; /**< Hashtable by time of all the ::snapraid_timecount. */
+	struct snapraid_timecount* last; /**< Last used entry, as near blocks likely share the time. */
+	struct snapraid_timecount** map; /**< Entries sorted by time. Valid after timehist_sort(). */
+	unsigned map_max; /**< Number of entries in ::map. */
+	block_off_t count; /**< Number of blocks inserted. */
+};
+
+/**
+ * Initialize an empty histogram.
+ */
+void timehist_init(struct snapraid_timehist* hist);
+
+/**
+ * Deinitialize the histogram.
+ */
+void timehist_done(struct snapraid_timehist* hist);
+
+/**
+ * Insert a number of blocks with the specified time.
+ */
+void timehist_insert(struct snapraid_timehist* hist, time_t time, block_off_t count);
+
+/**
+ * Sort the entries by time in ::map.
+ * After this call no more insertion is allowed.
+ */
+void timehist_sort(struct snapraid_timehist* hist);
+
 /**
- * Compare times
+ * Get the time of the block at the specified position in the time order.
+ * The position must be less than the number of blocks inserted.
  */
-int time_compare(const void* void_a, const void* void_b);
+time_t timehist_at(struct snapraid_timehist* hist, block_off_t pos);
 
 /****************************************************************************/
 /* format */
@@ -141,6 +141,45 @@ int handle_truncate(struct snapraid_handle* handle, struct snapraid_file* file)
 	return 0;
 }
 
+int handle_allocate(struct snapraid_handle* handle, struct snapraid_file* file, int skip_fallocate)
+{
+	int ret;
+
+	/* nothing to do for empty files */
+	if (file->size == 0)
+		return 0;
+
+#if HAVE_FALLOCATE
+	if (!skip_fallocate) {
+		ret = fallocate(handle->f, 0, 0, file->size);
+
+		/* some legacy systems return the error as positive integer */
+		if (ret > 0) {
+			/* LCOV_EXCL_START */
+			errno = ret;
+			ret = -1;
+			/* LCOV_EXCL_STOP */
+		}
+	} else {
+		errno = EOPNOTSUPP;
+		ret = -1;
+	}
+#else
+	(void)skip_fallocate; /* avoid the warning */
+
+	errno = EOPNOTSUPP;
+	ret = -1;
+#endif
+
+	/* it's only an optimization, the following writes are going to allocate the space anyway */
+	if (ret != 0) {
+		log_tag("file:allocate:%s:%" PRIu64 ": failed with error %s\n", handle->path, file->size, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
 int handle_open(struct snapraid_handle* handle, struct snapraid_file* file, int mode, fptr* out, fptr* out_missing)
 {
 	int ret;
@@ -167,6 +206,13 @@ int handle_open(struct snapraid_handle* handle, struct snapraid_file* file, int
 
 	/* open for read */
 	handle->f = open_noatime(handle->path, flags | O_RDONLY);
+
+	/* if direct access is not supported by the filesystem, retry with the cache */
+	if (handle->f == -1 && advise_direct_fallback(&handle->advise, -1) == 0) {
+		flags = O_BINARY | O_NOFOLLOW | advise_flags(&handle->advise);
+		handle->f = open_noatime(handle->path, flags | O_RDONLY);
+	}
+
 	if (handle->f == -1) {
 		/* invalidate for error */
 		handle->file = 0;
@@ -263,6 +309,11 @@ int handle_read(struct snapraid_handle* handle, block_off_t file_pos, unsigned c
 	do {
 		/* read the full block to support O_DIRECT */
 		read_ret = pread(handle->f, block_buffer + count, block_size - count, offset + count);
+
+		/* if the direct access is refused, retry with the cache */
+		if (read_ret < 0 && advise_direct_fallback(&handle->advise, handle->f) == 0)
+			continue;
+
 		if (read_ret < 0) {
 			/* LCOV_EXCL_START */
 			out("Error reading file '%s' at offset %" PRIu64 " for size %u. %s.\n", handle->path, offset + count, block_size - count, strerror(errno));
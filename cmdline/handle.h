@@ -50,6 +50,14 @@ int handle_create(struct snapraid_handle* handle, struct snapraid_file* file, in
  */
 int handle_truncate(struct snapraid_handle* handle, struct snapraid_file* file);
 
+/**
+ * Allocate the whole space of a file just created.
+ * This allows to write it sequentially without fragmentation.
+ * A failure is not an error, as the space is anyway allocated when writing.
+ * Return -1 if the space was not allocated.
+ */
+int handle_allocate(struct snapraid_handle* handle, struct snapraid_file* file, int skip_fallocate);
+
 /**
  * Open a file.
  * The file is opened for reading.
@@ -18,6 +18,7 @@
 #include "portable.h"
 
 #include "support.h"
+#include "stream.h"
 #include "import.h"
 
 /****************************************************************************/
@@ -52,25 +53,54 @@ static inline tommy_uint32_t import_block_hash(const unsigned char* hash)
 	return hash[0] | ((uint32_t)hash[1] << 8) | ((uint32_t)hash[2] << 16) | ((uint32_t)hash[3] << 24);
 }
 
-static void import_file(struct snapraid_state* state, const char* path, uint64_t size)
+/**
+ * Number of workers hashing the import files in parallel.
+ */
+#define IMPORT_WORKER_MAX 4
+
+/**
+ * Size of the reads of the import files.
+ * It's rounded down to a multiple of the block size.
+ */
+#define IMPORT_READ_SIZE (4 * MEBI)
+
+/**
+ * Add a file to import, without reading it.
+ */
+static void import_file(struct snapraid_state* state, const char* path, uint64_t size, int64_t mtime_sec, int mtime_nsec)
 {
 	struct snapraid_import_file* file;
-	block_off_t i;
-	data_off_t offset;
-	void* buffer;
-	int ret;
-	int f;
-	int flags;
 	unsigned block_size = state->block_size;
-	struct advise_struct advise;
 
 	file = malloc_nofail(sizeof(struct snapraid_import_file));
 	file->path = strdup_nofail(path);
 	file->size = size;
+	file->mtime_sec = mtime_sec;
+	file->mtime_nsec = mtime_nsec;
+	file->cached = 0;
 	file->blockmax = (size + block_size - 1) / block_size;
 	file->blockimp = malloc_nofail(file->blockmax * sizeof(struct snapraid_import_block));
 
-	buffer = malloc_nofail(block_size);
+	tommy_list_insert_tail(&state->importlist, &file->nodelist, file);
+}
+
+/**
+ * Read an import file and compute the hash of all its blocks.
+ *
+ * The file is read sequentially in chunks of many blocks.
+ * The buffer must be large enough for ::buffer_blocks blocks.
+ */
+static void import_file_hash(struct snapraid_state* state, struct snapraid_import_file* file, unsigned char* buffer, unsigned buffer_blocks)
+{
+	block_off_t i;
+	data_off_t offset;
+	data_off_t size;
+	int ret;
+	int f;
+	int flags;
+	unsigned block_size = state->block_size;
+	const char* path = file->path;
+	struct advise_struct advise;
 
 	advise_init(&advise, state->file_mode);
 
@@ -93,49 +123,559 @@ static void import_file(struct snapraid_state* state, const char* path, uint64_t
 	}
 
 	offset = 0;
+	size = file->size;
+	i = 0;
+	while (i < file->blockmax) {
+		size_t chunk_size;
+		size_t count;
+		unsigned char* ptr;
+
+		/* read many blocks at once */
+		chunk_size = buffer_blocks * (size_t)block_size;
+		if (chunk_size > (uint64_t)size)
+			chunk_size = size;
+
+		count = 0;
+		while (count < chunk_size) {
+			ssize_t read_ret = read(f, buffer + count, chunk_size - count);
+			if (read_ret <= 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Error reading file '%s'. %s.\n", path, strerror(errno));
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			count += read_ret;
+		}
+
+		/* hash all the blocks read */
+		ptr = buffer;
+		while (chunk_size != 0) {
+			struct snapraid_import_block* block = &file->blockimp[i];
+			unsigned read_size = block_size;
+			if (read_size > chunk_size)
+				read_size = chunk_size;
+
+			block->file = file;
+			block->offset = offset;
+			block->size = read_size;
+
+			memhash(state->hash, state->hashseed, block->hash, ptr, read_size);
+
+			/* if we are in a rehash state */
+			if (state->prevhash != HASH_UNDEFINED) {
+				/* compute also the previous hash */
+				memhash(state->prevhash, state->prevhashseed, block->prevhash, ptr, read_size);
+			}
+
+			ptr += read_size;
+			offset += read_size;
+			size -= read_size;
+			chunk_size -= read_size;
+			++i;
+		}
+	}
+
+	ret = close(f);
+	if (ret != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error closing file '%s'. %s.\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+/**
+ * Insert all the blocks of an import file in the hash tables.
+ */
+static void import_file_insert(struct snapraid_state* state, struct snapraid_import_file* file)
+{
+	block_off_t i;
+
 	for (i = 0; i < file->blockmax; ++i) {
 		struct snapraid_import_block* block = &file->blockimp[i];
-		unsigned read_size = block_size;
-		if (read_size > size)
-			read_size = size;
 
-		ret = read(f, buffer, read_size);
-		if (ret < 0 || (unsigned)ret != read_size) {
+		tommy_hashdyn_insert(&state->importset, &block->nodeset, block, import_block_hash(block->hash));
+
+		/* if we are in a rehash state */
+		if (state->prevhash != HASH_UNDEFINED)
+			tommy_hashdyn_insert(&state->previmportset, &block->prevnodeset, block, import_block_hash(block->prevhash));
+	}
+}
+
+/**
+ * Number of blocks read at once.
+ */
+static unsigned import_buffer_blocks(struct snapraid_state* state)
+{
+	unsigned buffer_blocks = IMPORT_READ_SIZE / state->block_size;
+
+	if (buffer_blocks == 0)
+		buffer_blocks = 1;
+
+	return buffer_blocks;
+}
+
+/**
+ * Signature of the import cache file.
+ */
+#define IMPORT_CACHE_MAGIC "SNAPIMP1"
+
+/**
+ * Import cache file.
+ * Hashes of an import file saved by a previous run.
+ */
+struct snapraid_import_cache {
+	char* path; /**< Full path of the file. */
+	data_off_t size;
+	int64_t mtime_sec;
+	int mtime_nsec;
+	block_off_t blockmax; /**< Number of blocks. */
+	unsigned char* hash; /**< Hashes of all the blocks. */
+	unsigned char* prevhash; /**< Previous hashes of all the blocks. Allocated only if we are in rehash state. */
+
+	/* nodes for data structures */
+	tommy_hashdyn_node node;
+};
+
+static void import_cache_free(struct snapraid_import_cache* cache)
+{
+	free(cache->path);
+	free(cache->hash);
+	free(cache->prevhash);
+	free(cache);
+}
+
+static int import_cache_compare(const void* void_arg, const void* void_data)
+{
+	const char* arg = void_arg;
+	const struct snapraid_import_cache* cache = void_data;
+
+	return strcmp(arg, cache->path);
+}
+
+/**
+ * Path of the import cache, saved alongside the first content file.
+ */
+static void import_cache_path(struct snapraid_state* state, char* path, size_t size)
+{
+	struct snapraid_content* content = tommy_list_head(&state->contentlist)->data;
+
+	pathprint(path, size, "%s.import", content->content);
+}
+
+/**
+ * Read the header of the import cache.
+ * Return 0 if the cache was saved with the same hash and block size of the current state.
+ */
+static int import_cache_read_header(struct snapraid_state* state, STREAM* f)
+{
+	char magic[sizeof(IMPORT_CACHE_MAGIC) - 1];
+	unsigned char seed[HASH_MAX];
+	uint32_t v;
+
+	if (sread(f, magic, sizeof(magic)) < 0 || memcmp(magic, IMPORT_CACHE_MAGIC, sizeof(magic)) != 0)
+		return -1;
+
+	if (sgetb32(f, &v) < 0 || v != state->block_size)
+		return -1;
+	if (sgetb32(f, &v) < 0 || v != (uint32_t)BLOCK_HASH_SIZE)
+		return -1;
+
+	if (sgetb32(f, &v) < 0 || v != (uint32_t)state->hash)
+		return -1;
+	if (sread(f, seed, HASH_MAX) < 0 || memcmp(seed, state->hashseed, HASH_MAX) != 0)
+		return -1;
+
+	if (sgetb32(f, &v) < 0 || v != (uint32_t)state->prevhash)
+		return -1;
+	if (state->prevhash != HASH_UNDEFINED) {
+		if (sread(f, seed, HASH_MAX) < 0 || memcmp(seed, state->prevhashseed, HASH_MAX) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Read a file entry of the import cache.
+ *
+ * \param file_size Size of the cache file, used to reject damaged entries
+ * before allocating their hashes.
+ */
+static struct snapraid_import_cache* import_cache_read_file(struct snapraid_state* state, STREAM* f, uint64_t file_size)
+{
+	struct snapraid_import_cache* cache;
+	char path[PATH_MAX];
+	uint64_t size;
+	uint64_t mtime_sec;
+	uint32_t mtime_nsec;
+	uint64_t blockmax;
+	uint64_t payload;
+	size_t hash_size;
+
+	if (sgetbs(f, path, sizeof(path)) < 0
+		|| sgetb64(f, &size) < 0
+		|| sgetb64(f, &mtime_sec) < 0
+		|| sgetb32(f, &mtime_nsec) < 0)
+		return 0;
+
+	/* the hashes cannot be more than the data left in the file */
+	blockmax = size / state->block_size + (size % state->block_size != 0);
+	payload = (uint64_t)BLOCK_HASH_SIZE;
+	if (state->prevhash != HASH_UNDEFINED)
+		payload *= 2;
+	if (blockmax != (block_off_t)blockmax
+		|| (uint64_t)stell(f) > file_size
+		|| blockmax > (file_size - stell(f)) / payload)
+		return 0;
+
+	cache = malloc_nofail(sizeof(struct snapraid_import_cache));
+	cache->path = strdup_nofail(path);
+	cache->size = size;
+	cache->mtime_sec = mtime_sec;
+	cache->mtime_nsec = mtime_nsec;
+	cache->blockmax = blockmax;
+	cache->prevhash = 0;
+
+	hash_size = cache->blockmax * (size_t)BLOCK_HASH_SIZE;
+	cache->hash = malloc_nofail(hash_size);
+	if (state->prevhash != HASH_UNDEFINED)
+		cache->prevhash = malloc_nofail(hash_size);
+
+	if (sread(f, cache->hash, hash_size) < 0
+		|| (cache->prevhash && sread(f, cache->prevhash, hash_size) < 0)) {
+		import_cache_free(cache);
+		return 0;
+	}
+
+	return cache;
+}
+
+/**
+ * Load the import cache.
+ *
+ * The cache is only an optimization, and if it's missing, damaged or
+ * saved with a different hash, it's simply ignored.
+ */
+static void import_cache_load(struct snapraid_state* state, tommy_hashdyn* cacheset)
+{
+	char path[PATH_MAX];
+	STREAM* f;
+	struct stat st;
+	int ret;
+
+	import_cache_path(state, path, sizeof(path));
+
+	f = sopen_read(path);
+	if (!f) {
+		if (errno != ENOENT) {
 			/* LCOV_EXCL_START */
-			log_fatal("Error reading file '%s'. %s.\n", path, strerror(errno));
-			exit(EXIT_FAILURE);
+			log_error("Error opening the import cache '%s'. %s.\n", path, strerror(errno));
 			/* LCOV_EXCL_STOP */
 		}
+		return;
+	}
 
-		block->file = file;
-		block->offset = offset;
-		block->size = read_size;
+	/* get the size of the cache file, to validate the entries */
+	if (fstat(shandle(f), &st) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("Error stating the import cache '%s'. %s.\n", path, strerror(errno));
+		sclose(f);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
 
-		memhash(state->hash, state->hashseed, block->hash, buffer, read_size);
-		tommy_hashdyn_insert(&state->importset, &block->nodeset, block, import_block_hash(block->hash));
+	ret = import_cache_read_header(state, f);
+	while (ret == 0) {
+		struct snapraid_import_cache* cache;
+		uint32_t crc_stored;
+		uint32_t crc_computed;
+		int c;
+
+		c = sgetc(f);
+		if (c == 'f') {
+			cache = import_cache_read_file(state, f, st.st_size);
+			if (!cache) {
+				ret = -1;
+				break;
+			}
+			tommy_hashdyn_insert(cacheset, &cache->node, cache, file_path_hash(cache->path));
+		} else if (c == 'N') {
+			/* get the crc before reading it from the file */
+			crc_computed = scrc(f);
+
+			if (sgetble32(f, &crc_stored) < 0 || crc_stored != crc_computed)
+				ret = -1;
+			break;
+		} else {
+			ret = -1;
+		}
+	}
 
-		/* if we are in a rehash state */
+	sclose(f);
+
+	if (ret != 0) {
+		msg_verbose("Ignoring the import cache '%s'\n", path);
+		tommy_hashdyn_foreach(cacheset, (tommy_foreach_func*)import_cache_free);
+		tommy_hashdyn_done(cacheset);
+		tommy_hashdyn_init(cacheset);
+	}
+}
+
+/**
+ * Save the hashes of all the import files in the import cache.
+ *
+ * Errors are reported but not fatal, as the cache is only an optimization.
+ */
+static void import_cache_save(struct snapraid_state* state)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX];
+	STREAM* f;
+	tommy_node* i;
+	uint32_t crc;
+
+	import_cache_path(state, path, sizeof(path));
+	pathprint(tmp, sizeof(tmp), "%s.tmp", path);
+
+	/* ensure to delete a previous stale file */
+	if (remove(tmp) != 0 && errno != ENOENT) {
+		/* LCOV_EXCL_START */
+		log_error("Error removing the stale import cache '%s'. %s.\n", tmp, strerror(errno));
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	f = sopen_write(tmp);
+	if (!f) {
+		/* LCOV_EXCL_START */
+		log_error("Error creating the import cache '%s'. %s.\n", tmp, strerror(errno));
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	swrite(IMPORT_CACHE_MAGIC, sizeof(IMPORT_CACHE_MAGIC) - 1, f);
+	sputb32(state->block_size, f);
+	sputb32(BLOCK_HASH_SIZE, f);
+	sputb32(state->hash, f);
+	swrite(state->hashseed, HASH_MAX, f);
+	sputb32(state->prevhash, f);
+	if (state->prevhash != HASH_UNDEFINED)
+		swrite(state->prevhashseed, HASH_MAX, f);
+
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+		struct snapraid_import_file* file = i->data;
+		block_off_t j;
+
+		sputc('f', f);
+		sputbs(file->path, f);
+		sputb64(file->size, f);
+		sputb64(file->mtime_sec, f);
+		sputb32(file->mtime_nsec, f);
+		for (j = 0; j < file->blockmax; ++j)
+			swrite(file->blockimp[j].hash, BLOCK_HASH_SIZE, f);
 		if (state->prevhash != HASH_UNDEFINED) {
-			/* compute also the previous hash */
-			memhash(state->prevhash, state->prevhashseed, block->prevhash, buffer, read_size);
-			tommy_hashdyn_insert(&state->previmportset, &block->prevnodeset, block, import_block_hash(block->prevhash));
+			for (j = 0; j < file->blockmax; ++j)
+				swrite(file->blockimp[j].prevhash, BLOCK_HASH_SIZE, f);
 		}
+	}
 
-		offset += read_size;
-		size -= read_size;
+	sputc('N', f);
+
+	if (sflush(f)) {
+		/* LCOV_EXCL_START */
+		log_error("Error writing the import cache '%s'. %s.\n", tmp, strerror(errno));
+		sclose(f);
+		return;
+		/* LCOV_EXCL_STOP */
 	}
 
-	ret = close(f);
-	if (ret != 0) {
+	crc = scrc(f);
+	sputble32(crc, f);
+
+	if (serror(f) || sclose(f) != 0) {
 		/* LCOV_EXCL_START */
-		log_fatal("Error closing file '%s'. %s.\n", path, strerror(errno));
-		exit(EXIT_FAILURE);
+		log_error("Error writing the import cache '%s'. %s.\n", tmp, strerror(errno));
+		return;
 		/* LCOV_EXCL_STOP */
 	}
 
-	tommy_list_insert_tail(&state->importlist, &file->nodelist, file);
+	if (rename(tmp, path) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("Error renaming the import cache '%s' to '%s'. %s.\n", tmp, path, strerror(errno));
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+/**
+ * Fill the hashes of an import file from the cache.
+ * Return 0 if the file is in the cache with the same size and timestamp.
+ */
+static int import_cache_fetch(struct snapraid_state* state, tommy_hashdyn* cacheset, struct snapraid_import_file* file)
+{
+	struct snapraid_import_cache* cache;
+	unsigned block_size = state->block_size;
+	data_off_t offset;
+	data_off_t size;
+	block_off_t i;
+
+	cache = tommy_hashdyn_search(cacheset, import_cache_compare, file->path, file_path_hash(file->path));
+	if (!cache)
+		return -1;
+
+	if (cache->size != file->size
+		|| cache->mtime_sec != file->mtime_sec
+		|| cache->mtime_nsec != file->mtime_nsec)
+		return -1;
+
+	offset = 0;
+	size = file->size;
+	for (i = 0; i < file->blockmax; ++i) {
+		struct snapraid_import_block* block = &file->blockimp[i];
+		unsigned read_size = block_size;
+		if (read_size > size)
+			read_size = size;
+
+		block->file = file;
+		block->offset = offset;
+		block->size = read_size;
+
+		memcpy(block->hash, cache->hash + i * (size_t)BLOCK_HASH_SIZE, BLOCK_HASH_SIZE);
+		if (cache->prevhash)
+			memcpy(block->prevhash, cache->prevhash + i * (size_t)BLOCK_HASH_SIZE, BLOCK_HASH_SIZE);
+
+		offset += read_size;
+		size -= read_size;
+	}
+
+	return 0;
+}
+
+#if HAVE_THREAD
+/**
+ * Shared state of the workers hashing the import files.
+ */
+struct import_pool {
+	struct snapraid_state* state;
+	tommy_node* next; /**< Next file to hash. */
+	thread_mutex_t mutex;
+};
+
+static void* import_worker_thread(void* arg)
+{
+	struct import_pool* pool = arg;
+	struct snapraid_state* state = pool->state;
+	unsigned buffer_blocks = import_buffer_blocks(state);
+	unsigned char* buffer;
+
+	buffer = malloc_nofail(buffer_blocks * (size_t)state->block_size);
+
+	while (1) {
+		struct snapraid_import_file* file;
+
+		/* get the next file to hash */
+		thread_mutex_lock(&pool->mutex);
+		if (!pool->next) {
+			thread_mutex_unlock(&pool->mutex);
+			break;
+		}
+		file = pool->next->data;
+		pool->next = pool->next->next;
+		thread_mutex_unlock(&pool->mutex);
+
+		if (file->cached)
+			continue;
+
+		import_file_hash(state, file, buffer, buffer_blocks);
+	}
 
 	free(buffer);
+
+	return 0;
+}
+#endif
+
+/**
+ * Hash all the import files.
+ *
+ * Different files are hashed in parallel, and the blocks are inserted
+ * in the hash tables only at the end, in the same order of the files.
+ */
+static void import_hash(struct snapraid_state* state, int fix)
+{
+	tommy_node* i;
+	tommy_hashdyn cacheset;
+	unsigned count_cached;
+	unsigned count_file;
+
+	/* reuse the hashes of the files not changed since the previous run */
+	tommy_hashdyn_init(&cacheset);
+	import_cache_load(state, &cacheset);
+
+	count_cached = 0;
+	count_file = 0;
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+		struct snapraid_import_file* file = i->data;
+
+		if (import_cache_fetch(state, &cacheset, file) == 0) {
+			file->cached = 1;
+			++count_cached;
+		}
+		++count_file;
+	}
+
+	tommy_hashdyn_foreach(&cacheset, (tommy_foreach_func*)import_cache_free);
+	tommy_hashdyn_done(&cacheset);
+
+	if (count_cached != 0)
+		msg_verbose("Reusing the import cache for %u of %u files\n", count_cached, count_file);
+
+#if HAVE_THREAD
+	/* use threads, unless the io cache is disabled */
+	if (state->opt.io_cache != 1 && tommy_list_count(&state->importlist) > 1) {
+		struct import_pool pool;
+		thread_id_t thread_map[IMPORT_WORKER_MAX];
+		unsigned j;
+
+		pool.state = state;
+		pool.next = tommy_list_head(&state->importlist);
+		thread_mutex_init(&pool.mutex);
+
+		for (j = 0; j < IMPORT_WORKER_MAX; ++j)
+			thread_create(&thread_map[j], import_worker_thread, &pool);
+
+		for (j = 0; j < IMPORT_WORKER_MAX; ++j) {
+			void* retval;
+
+			thread_join(thread_map[j], &retval);
+		}
+
+		thread_mutex_destroy(&pool.mutex);
+	} else
+#endif
+	{
+		unsigned buffer_blocks = import_buffer_blocks(state);
+		unsigned char* buffer;
+
+		buffer = malloc_nofail(buffer_blocks * (size_t)state->block_size);
+
+		for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+			struct snapraid_import_file* file = i->data;
+
+			if (!file->cached)
+				import_file_hash(state, file, buffer, buffer_blocks);
+		}
+
+		free(buffer);
+	}
+
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next)
+		import_file_insert(state, i->data);
+
+	/* save the hashes for the next run, only if fixing and something changed */
+	if (fix && count_cached != count_file)
+		import_cache_save(state);
 }
 
 void import_file_free(struct snapraid_import_file* file)
@@ -284,7 +824,7 @@ static void import_dir(struct snapraid_state* state, const char* dir)
 #endif
 
 		if (S_ISREG(st.st_mode)) {
-			import_file(state, path_next, st.st_size);
+			import_file(state, path_next, st.st_size, st.st_mtime, STAT_NSEC(&st));
 		} else if (S_ISDIR(st.st_mode)) {
 			pathslash(path_next, sizeof(path_next));
 			import_dir(state, path_next);
@@ -299,7 +839,7 @@ static void import_dir(struct snapraid_state* state, const char* dir)
 	}
 }
 
-void state_import(struct snapraid_state* state, const char* dir)
+void state_import(struct snapraid_state* state, const char* dir, int fix)
 {
 	char path[PATH_MAX];
 
@@ -318,5 +858,7 @@ void state_import(struct snapraid_state* state, const char* dir)
 	pathslash(path, sizeof(path));
 
 	import_dir(state, path);
+
+	import_hash(state, fix);
 }
 
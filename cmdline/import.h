@@ -46,6 +46,9 @@ struct snapraid_import_block {
  */
 struct snapraid_import_file {
 	data_off_t size; /**< Size of the file. */
+	int64_t mtime_sec; /**< Modification time of the file. */
+	int mtime_nsec;
+	int cached; /**< If the hashes of the blocks were loaded from the import cache. */
 	struct snapraid_import_block* blockimp; /**< All the blocks of the file. */
 	block_off_t blockmax; /**< Number of blocks. */
 	char* path; /**< Full path of the file. */
@@ -67,8 +70,11 @@ int state_import_fetch(struct snapraid_state* state, int prevhash, struct snapra
 
 /**
  * Import files from the specified directory.
+ *
+ * \param fix If the import cache has to be updated. Only "fix" does it,
+ * so "check" never writes files.
  */
-void state_import(struct snapraid_state* state, const char* dir);
+void state_import(struct snapraid_state* state, const char* dir, int fix);
 
 #endif
 
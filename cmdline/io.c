@@ -40,10 +40,8 @@ static block_off_t io_position_next(struct snapraid_io* io)
 	block_off_t blockcur;
 
 	/* get the next position */
-	if (io->block_enabled) {
-		while (io->block_next < io->block_max && !bit_vect_test(io->block_enabled, io->block_next))
-			++io->block_next;
-	}
+	if (io->block_enabled && io->block_next < io->block_max)
+		io->block_next = bit_vect_next(io->block_enabled, io->block_next, io->block_max);
 
 	blockcur = io->block_next;
 
@@ -135,6 +133,47 @@ static void io_writer_sched_empty(struct snapraid_io* io, int task_index, block_
 	}
 }
 
+/**
+ * Maximum time of reads allowed at full speed after an idle period,
+ * when the read speed is limited.
+ */
+#define IO_LIMIT_BURST_US 250000
+
+/**
+ * Delay the reader to respect the speed limit.
+ *
+ * It works like a token bucket, with the bucket size of ::IO_LIMIT_BURST_US.
+ */
+static void io_reader_limit(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	struct snapraid_io* io = worker->io;
+	uint64_t now;
+	uint64_t size;
+
+	if (io->reader_limit == 0)
+		return;
+
+	/* parity is always read as a full block */
+	if (worker->parity_handle)
+		size = io->state->block_size;
+	else if (task->read_size > 0)
+		size = task->read_size;
+	else
+		return;
+
+	now = tick_ms() * 1000;
+
+	/* don't accumulate more than a burst after an idle period */
+	if (worker->limit_us + IO_LIMIT_BURST_US < now)
+		worker->limit_us = now - IO_LIMIT_BURST_US;
+
+	/* time required to read the data at the limited speed */
+	worker->limit_us += size * 1000000 / io->reader_limit;
+
+	if (worker->limit_us > now)
+		sleep_ms((worker->limit_us - now) / 1000);
+}
+
 /*****************************************************************************/
 /* mono thread */
 
@@ -208,9 +247,12 @@ static struct snapraid_task* io_task_read_mono(struct snapraid_io* io, unsigned
 	task = &worker->task_map[0];
 
 	/* do the work */
-	if (task->state != TASK_STATE_EMPTY)
+	if (task->state != TASK_STATE_EMPTY) {
 		worker->func(worker, task);
 
+		io_reader_limit(worker, task);
+	}
+
 	/* return the position */
 	*pos = i - base;
 
@@ -282,6 +324,13 @@ static void io_stop_mono(struct snapraid_io* io)
  * Get the next task to work on for a reader.
  *
  * This is the synchronization point for workers with the io.
+ *
+ * Each reader can fill all the ring, independently of the others.
+ * As every slot holds the buffers of all the disks, the ring size is
+ * the memory bound, and a fast disk already gets as much read-ahead
+ * as possible, while a slow one is always behind it. A lower depth
+ * for some readers would only reduce how much they can hide the
+ * latency of the others.
  */
 static struct snapraid_task* io_reader_step(struct snapraid_worker* worker)
 {
@@ -338,19 +387,36 @@ static struct snapraid_task* io_reader_step(struct snapraid_worker* worker)
  * Get the next task to work on for a writer.
  *
  * This is the synchronization point for workers with the io.
+ *
+ * The worker reports the number of tasks completed starting from its current
+ * index, and the errors found in them. It gets the next task and the
+ * number of tasks already scheduled after it, that it's allowed to process
+ * together.
  */
-static struct snapraid_task* io_writer_step(struct snapraid_worker* worker, int state)
+static struct snapraid_task* io_writer_step(struct snapraid_worker* worker, unsigned done, int* error, unsigned* pending)
 {
 	struct snapraid_io* io = worker->io;
-	int error_index;
+	unsigned i;
 
 	/* the synchronization is protected by the io mutex */
 	thread_mutex_lock(&io->io_mutex);
 
 	/* counts the number of errors in the global state */
-	error_index = state - IO_WRITER_ERROR_BASE;
-	if (error_index >= 0 && error_index < IO_WRITER_ERROR_MAX)
-		++io->writer_error[error_index];
+	for (i = 0; i < IO_WRITER_ERROR_MAX; ++i) {
+		io->writer_error[i] += error[i];
+		error[i] = 0;
+	}
+
+	/* if more tasks were completed, move to the latest one */
+	if (done > 1) {
+		/* if the IO is waiting for the first one, notify it */
+		/* note that only the first one can be waited for, */
+		/* because the IO waits always for the oldest one */
+		if (worker->index == (io->writer_index + 1) % io->io_max)
+			thread_cond_signal(&io->write_done);
+
+		worker->index = (worker->index + done - 1) % io->io_max;
+	}
 
 	while (1) {
 		unsigned next_index;
@@ -372,6 +438,9 @@ static struct snapraid_task* io_writer_step(struct snapraid_worker* worker, int
 			worker->index = next_index;
 			task = &worker->task_map[worker->index];
 
+			/* count the other tasks already scheduled after it */
+			*pending = (io->writer_index + io->io_max - next_index) % io->io_max - 1;
+
 			/* if the just completed task is at this index */
 			if (done_index == waiting_index) {
 				/* notify the IO that a new write is complete */
@@ -400,6 +469,12 @@ static struct snapraid_task* io_writer_step(struct snapraid_worker* worker, int
  * Get the next block position to operate on.
  *
  * This is the synchronization point for workers with the io.
+ *
+ * Positions are returned in order. Each reader processes its tasks in
+ * ring order, so a position is complete only after all the previous
+ * ones, and the oldest one in the ring is always the first to be ready.
+ * A slow read in a disk is hidden only by the other disks reading ahead
+ * in the ring, not by changing the processing order.
  */
 static block_off_t io_read_next_thread(struct snapraid_io* io, void*** buffer)
 {
@@ -700,6 +775,8 @@ static void io_reader_worker(struct snapraid_worker* worker, struct snapraid_tas
 		task->state = TASK_STATE_EMPTY;
 	} else {
 		worker->func(worker, task);
+
+		io_reader_limit(worker, task);
 	}
 }
 
@@ -733,16 +810,64 @@ static void* io_reader_thread(void* arg)
 	return 0;
 }
 
+/**
+ * Write a run of tasks at consecutive positions.
+ *
+ * All the blocks are written with a single parity_write_run() call.
+ * On error they are retried one by one with the writer function,
+ * to report the exact position that failed.
+ */
+static void io_writer_run(struct snapraid_worker* worker, struct snapraid_task** task_run, unsigned count, int* error)
+{
+	struct snapraid_io* io = worker->io;
+	unsigned i;
+
+	if (count > 1) {
+		unsigned char* buffer_run[PARITY_RUN_MAX];
+
+		for (i = 0; i < count; ++i)
+			buffer_run[i] = task_run[i]->buffer;
+
+		if (parity_write_run(worker->parity_handle, task_run[0]->position, buffer_run, count, io->state->block_size) == 0) {
+			for (i = 0; i < count; ++i)
+				task_run[i]->state = TASK_STATE_DONE;
+			return;
+		}
+	}
+
+	for (i = 0; i < count; ++i) {
+		int error_index;
+
+		/* work on the assigned task */
+		worker->func(worker, task_run[i]);
+
+		/* count the errors */
+		error_index = task_run[i]->state - IO_WRITER_ERROR_BASE;
+		if (error_index >= 0 && error_index < IO_WRITER_ERROR_MAX)
+			++error[error_index];
+	}
+}
+
 static void* io_writer_thread(void* arg)
 {
 	struct snapraid_worker* worker = arg;
-	int latest_state = TASK_STATE_DONE;
+	struct snapraid_io* io = worker->io;
+	int error[IO_WRITER_ERROR_MAX];
+	unsigned done;
+	unsigned i;
 
+	for (i = 0; i < IO_WRITER_ERROR_MAX; ++i)
+		error[i] = 0;
+
+	done = 1;
 	while (1) {
+		struct snapraid_task* task_run[PARITY_RUN_MAX];
 		struct snapraid_task* task;
+		unsigned pending;
+		unsigned count;
 
 		/* get the new task */
-		task = io_writer_step(worker, latest_state);
+		task = io_writer_step(worker, done, error, &pending);
 
 		/* if no task, it means to exit */
 		if (!task)
@@ -750,17 +875,30 @@ static void* io_writer_thread(void* arg)
 
 		/* nothing more to do */
 		if (task->state == TASK_STATE_EMPTY) {
-			latest_state = TASK_STATE_DONE;
+			done = 1;
 			continue;
 		}
 
 		assert(task->state == TASK_STATE_READY);
 
-		/* work on the assigned task */
-		worker->func(worker, task);
+		/* collect the tasks already scheduled at the following positions */
+		/* when the parity disk is slower than the rest, they accumulate */
+		/* and they can be written together */
+		task_run[0] = task;
+		count = 1;
+		while (count <= pending && count < PARITY_RUN_MAX) {
+			struct snapraid_task* next = &worker->task_map[(worker->index + count) % io->io_max];
+
+			if (next->state != TASK_STATE_READY || next->position != task->position + count)
+				break;
+
+			task_run[count++] = next;
+		}
 
-		/* save the resulting state */
-		latest_state = task->state;
+		/* work on the assigned tasks */
+		io_writer_run(worker, task_run, count, error);
+
+		done = count;
 	}
 
 	return 0;
@@ -930,10 +1068,14 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 	io->parity_base = handle_max;
 	io->parity_count = parity_handle_max;
 
+	/* no speed limit by default */
+	io->reader_limit = 0;
+
 	for (i = 0; i < io->reader_max; ++i) {
 		struct snapraid_worker* worker = &io->reader_map[i];
 
 		worker->io = io;
+		worker->limit_us = 0;
 
 		if (i < handle_max) {
 			/* it's a data read */
@@ -1000,6 +1142,16 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 	}
 }
 
+void io_limit(struct snapraid_io* io, uint64_t speed)
+{
+	unsigned i;
+
+	io->reader_limit = speed;
+
+	for (i = 0; i < io->reader_max; ++i)
+		io->reader_map[i].limit_us = 0;
+}
+
 void io_done(struct snapraid_io* io)
 {
 	unsigned i;
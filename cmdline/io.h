@@ -59,7 +59,8 @@
  * This represents the minimal element of work that worker threads are
  * going to be asked to do.
  *
- * It consists in reading a block of data from a disk.
+ * It consists in reading a block of data from a disk, and optionally
+ * in computing its hash, to have it done in parallel for all the disks.
  *
  * Note that the disk to use is defined implicitly in the worker thread.
  */
@@ -78,6 +79,9 @@ struct snapraid_task {
 	block_off_t file_pos;
 	int read_size; /**< Size of the data read. */
 	int is_timestamp_different; /**< Report if file has a changed timestamp. */
+	unsigned char hash[HASH_MAX]; /**< Hash of the data read, if computed by the worker. */
+	unsigned char rehash[HASH_MAX]; /**< New hash of the data read, if computed by the worker during a rehash. */
+	uint64_t tick_hash; /**< Time spent by the worker computing the hash. */
 };
 
 /**
@@ -121,6 +125,12 @@ struct snapraid_worker {
 	 * Which buffer base index should be used for destination.
 	 */
 	unsigned buffer_skew;
+
+	/**
+	 * Time in microseconds when the reader is allowed to read again,
+	 * if its speed is limited.
+	 */
+	uint64_t limit_us;
 };
 
 /**
@@ -270,6 +280,13 @@ struct snapraid_io {
 	 */
 	unsigned reader_index;
 
+	/**
+	 * Maximum read speed of each reader, in bytes per second.
+	 *
+	 * 0 means unlimited.
+	 */
+	uint64_t reader_limit;
+
 	/**
 	 * The task currently used by the caller.
 	 *
@@ -304,6 +321,16 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 	void (*parity_writer)(struct snapraid_worker*, struct snapraid_task*),
 	struct snapraid_parity_handle* parity_handle_map, unsigned parity_handle_max);
 
+/**
+ * Limit the read speed of each disk.
+ *
+ * The reads are delayed to not exceed the specified speed on average.
+ * Short bursts after idle periods are allowed.
+ *
+ * \param speed Maximum speed in bytes per second. 0 for unlimited.
+ */
+void io_limit(struct snapraid_io* io, uint64_t speed);
+
 /**
  * Deinitialize the InputOutput workers.
  */
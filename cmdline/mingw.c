@@ -2065,6 +2065,11 @@ uint64_t tick_ms(void)
 	return GetTickCount();
 }
 
+void sleep_ms(unsigned ms)
+{
+	Sleep(ms);
+}
+
 int randomize(void* void_ptr, size_t size)
 {
 	size_t i;
@@ -198,6 +198,13 @@ int parity_create(struct snapraid_parity_handle* handle, const struct snapraid_p
 		/* opening in sequential mode in Windows */
 		flags = O_RDWR | O_CREAT | O_BINARY | advise_flags(&split->advise);
 		split->f = open(split->path, flags, 0600);
+
+		/* if direct access is not supported by the filesystem, retry with the cache */
+		if (split->f == -1 && advise_direct_fallback(&split->advise, -1) == 0) {
+			flags = O_RDWR | O_CREAT | O_BINARY | advise_flags(&split->advise);
+			split->f = open(split->path, flags, 0600);
+		}
+
 		if (split->f == -1) {
 			/* LCOV_EXCL_START */
 			log_fatal("Error opening parity file '%s'. %s.\n", split->path, strerror(errno));
@@ -685,6 +692,13 @@ int parity_open(struct snapraid_parity_handle* handle, const struct snapraid_par
 		flags = O_RDONLY | O_BINARY | advise_flags(&split->advise);
 
 		split->f = open_noatime(split->path, flags);
+
+		/* if direct access is not supported by the filesystem, retry with the cache */
+		if (split->f == -1 && advise_direct_fallback(&split->advise, -1) == 0) {
+			flags = O_RDONLY | O_BINARY | advise_flags(&split->advise);
+			split->f = open_noatime(split->path, flags);
+		}
+
 		if (split->f == -1) {
 			/* LCOV_EXCL_START */
 			log_fatal("Error opening parity file '%s'. %s.\n", split->path, strerror(errno));
@@ -771,6 +785,110 @@ int parity_sync(struct snapraid_parity_handle* handle)
 	return 0;
 }
 
+#if HAVE_FSYNC && HAVE_THREAD
+/**
+ * Flush of a single parity split in a separated thread.
+ */
+struct parity_sync_split {
+	thread_id_t thread; /**< Thread used for the flush. */
+	struct snapraid_split_handle* split; /**< Split to flush. */
+	int ret; /**< Result of the flush. */
+	int err; /**< Errno of the flush. */
+};
+
+static void* parity_sync_split_thread(void* arg)
+{
+	struct parity_sync_split* sync = arg;
+
+	sync->ret = fsync(sync->split->f);
+	sync->err = errno;
+
+	return 0;
+}
+#endif
+
+#if HAVE_FSYNC && HAVE_THREAD
+/**
+ * Flush all the split files, one thread for each file.
+ */
+static int parity_sync_parallel(struct snapraid_parity_handle* handle_map, unsigned handle_max, unsigned sync_max, unsigned* failed)
+{
+	struct parity_sync_split* sync_map;
+	unsigned l, s, i;
+	int ret;
+
+	sync_map = malloc_nofail(sync_max * sizeof(struct parity_sync_split));
+
+	i = 0;
+	for (l = 0; l < handle_max; ++l) {
+		for (s = 0; s < handle_map[l].split_mac; ++s) {
+			sync_map[i].split = &handle_map[l].split_map[s];
+			thread_create(&sync_map[i].thread, parity_sync_split_thread, &sync_map[i]);
+			++i;
+		}
+	}
+
+	/* wait for all threads to terminate */
+	for (i = 0; i < sync_max; ++i) {
+		void* retval;
+
+		thread_join(sync_map[i].thread, &retval);
+	}
+
+	/* report the first error */
+	ret = 0;
+	i = 0;
+	for (l = 0; l < handle_max && ret == 0; ++l) {
+		for (s = 0; s < handle_map[l].split_mac; ++s, ++i) {
+			if (sync_map[i].ret != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Error syncing parity file '%s'. %s.\n", sync_map[i].split->path, strerror(sync_map[i].err));
+				*failed = l;
+				ret = -1;
+				break;
+				/* LCOV_EXCL_STOP */
+			}
+		}
+	}
+
+	free(sync_map);
+
+	return ret;
+}
+#endif
+
+int parity_sync_all(struct snapraid_parity_handle* handle_map, unsigned handle_max, int is_thread, unsigned* failed)
+{
+	unsigned l;
+
+#if HAVE_FSYNC && HAVE_THREAD
+	unsigned sync_max;
+
+	/* count the files to flush */
+	sync_max = 0;
+	for (l = 0; l < handle_max; ++l)
+		sync_max += handle_map[l].split_mac;
+
+	/* flush them in parallel, as they are usually on different disks */
+	if (is_thread && sync_max > 1)
+		return parity_sync_parallel(handle_map, handle_max, sync_max, failed);
+#else
+	(void)is_thread;
+#endif
+
+	/* flush them one after the other */
+	for (l = 0; l < handle_max; ++l) {
+		if (parity_sync(&handle_map[l]) != 0) {
+			/* LCOV_EXCL_START */
+			*failed = l;
+			return -1;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	return 0;
+}
+
 int parity_truncate(struct snapraid_parity_handle* handle)
 {
 	unsigned s;
@@ -865,6 +983,11 @@ int parity_write(struct snapraid_parity_handle* handle, block_off_t pos, unsigne
 		split->valid_size = offset + block_size;
 
 	write_ret = pwrite(split->f, block_buffer, block_size, offset);
+
+	/* if the direct access is refused, retry with the cache */
+	if (write_ret < 0 && advise_direct_fallback(&split->advise, split->f) == 0)
+		write_ret = pwrite(split->f, block_buffer, block_size, offset);
+
 	if (write_ret != (ssize_t)block_size) { /* conversion is safe because block_size is always small */
 		/* LCOV_EXCL_START */
 		if (errno == ENOSPC) {
@@ -887,6 +1010,89 @@ int parity_write(struct snapraid_parity_handle* handle, block_off_t pos, unsigne
 	return 0;
 }
 
+/**
+ * Write a group of consecutive blocks contained in the same split.
+ */
+static int parity_write_group(struct snapraid_split_handle* split, data_off_t offset, unsigned char** block_buffer, unsigned count, unsigned block_size)
+{
+	size_t size = count * (size_t)block_size;
+	int ret;
+#if HAVE_PWRITEV
+	struct iovec iov[PARITY_RUN_MAX];
+	ssize_t write_ret;
+	unsigned i;
+
+	for (i = 0; i < count; ++i) {
+		iov[i].iov_base = block_buffer[i];
+		iov[i].iov_len = block_size;
+	}
+
+	/* a partial write is handled as an error, and retried by the caller */
+	write_ret = pwritev(split->f, iov, count, offset);
+	if (write_ret != (ssize_t)size)
+		return -1;
+#else
+	unsigned i;
+
+	for (i = 0; i < count; ++i) {
+		ssize_t write_ret = pwrite(split->f, block_buffer[i], block_size, offset + i * (data_off_t)block_size);
+		if (write_ret != (ssize_t)block_size)
+			return -1;
+	}
+#endif
+
+	/* update the valid range */
+	if (split->valid_size < offset + (data_off_t)size)
+		split->valid_size = offset + size;
+
+	ret = advise_write(&split->advise, split->f, offset, size);
+	if (ret != 0)
+		return -1;
+
+	return 0;
+}
+
+int parity_write_run(struct snapraid_parity_handle* handle, block_off_t pos, unsigned char** block_buffer, unsigned count, unsigned block_size)
+{
+	struct snapraid_split_handle* group_split;
+	data_off_t group_offset;
+	unsigned group_begin;
+	unsigned i;
+
+	assert(count <= PARITY_RUN_MAX);
+
+	group_split = 0;
+	group_offset = 0;
+	group_begin = 0;
+	for (i = 0; i < count; ++i) {
+		data_off_t offset = (pos + i) * (data_off_t)block_size;
+		struct snapraid_split_handle* split;
+
+		split = parity_split_find(handle, &offset);
+		if (!split)
+			return -1;
+
+		/* if the block continues the current group, just extend it */
+		if (split == group_split && offset == group_offset + (i - group_begin) * (data_off_t)block_size)
+			continue;
+
+		/* write the previous group */
+		if (group_split && parity_write_group(group_split, group_offset, block_buffer + group_begin, i - group_begin, block_size) != 0)
+			return -1;
+
+		/* start a new group */
+		group_split = split;
+		group_offset = offset;
+		group_begin = i;
+	}
+
+	/* write the last group */
+	if (group_split && parity_write_group(group_split, group_offset, block_buffer + group_begin, count - group_begin, block_size) != 0)
+		return -1;
+
+	return 0;
+}
+
 int parity_read(struct snapraid_parity_handle* handle, block_off_t pos, unsigned char* block_buffer, unsigned block_size, fptr* out)
 {
 	ssize_t read_ret;
@@ -916,6 +1122,11 @@ int parity_read(struct snapraid_parity_handle* handle, block_off_t pos, unsigned
 	count = 0;
 	do {
 		read_ret = pread(split->f, block_buffer + count, block_size - count, offset + count);
+
+		/* if the direct access is refused, retry with the cache */
+		if (read_ret < 0 && advise_direct_fallback(&split->advise, split->f) == 0)
+			continue;
+
 		if (read_ret < 0) {
 			/* LCOV_EXCL_START */
 			out("Error reading file '%s' at offset %" PRIu64 " for size %u. %s.\n", split->path, offset + count, block_size - count, strerror(errno));
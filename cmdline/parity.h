@@ -123,6 +123,16 @@ int parity_open(struct snapraid_parity_handle* handle, const struct snapraid_par
  */
 int parity_sync(struct snapraid_parity_handle* handle);
 
+/**
+ * Flush the parity files of all the levels in the disk.
+ *
+ * All the split files of all the levels are flushed in parallel, one thread
+ * for each file, as they are usually on different disks.
+ * \param is_thread If threads can be used. Otherwise the files are flushed one after the other.
+ * \param failed Where the index of the handle that failed is stored.
+ */
+int parity_sync_all(struct snapraid_parity_handle* handle_map, unsigned handle_max, int is_thread, unsigned* failed);
+
 /**
  * Truncate the parity file to the valid size.
  */
@@ -143,5 +153,22 @@ int parity_read(struct snapraid_parity_handle* handle, block_off_t pos, unsigned
  */
 int parity_write(struct snapraid_parity_handle* handle, block_off_t pos, unsigned char* block_buffer, unsigned block_size);
 
+/**
+ * Max number of blocks written by parity_write_run().
+ */
+#define PARITY_RUN_MAX 64
+
+/**
+ * Write a run of consecutive blocks in the parity file.
+ *
+ * The blocks are written with a single vectored write for each split they span.
+ * No more than PARITY_RUN_MAX blocks can be written at once.
+ *
+ * On error nothing is logged, and the blocks may be partially written.
+ * The caller is expected to retry them one by one with parity_write() to
+ * report the exact error.
+ */
+int parity_write_run(struct snapraid_parity_handle* handle, block_off_t pos, unsigned char** block_buffer, unsigned count, unsigned block_size);
+
 #endif
 
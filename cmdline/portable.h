@@ -121,6 +121,14 @@
 #include <sys/ioctl.h>
 #endif
 
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 #if HAVE_LINUX_FS_H
 #include <linux/fs.h>
 #endif
@@ -384,9 +392,18 @@ uint64_t tick(void);
 
 /**
  * Get the tick counter value in millisecond.
+ *
+ * The counter is monotonic when the platform allows it, so it's not
+ * affected by changes of the system clock, and it can be used to
+ * measure and schedule elapsed times.
  */
 uint64_t tick_ms(void);
 
+/**
+ * Sleep for the specified number of milliseconds.
+ */
+void sleep_ms(unsigned ms);
+
 /**
  * Initializes the system.
  */
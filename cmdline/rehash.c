@@ -32,6 +32,7 @@ void state_rehash(struct snapraid_state* state)
 {
 	block_off_t blockmax;
 	block_off_t i;
+	block_off_t count;
 
 	blockmax = parity_allocated_size(state);
 
@@ -63,12 +64,12 @@ void state_rehash(struct snapraid_state* state)
 		/* LCOV_EXCL_STOP */
 	}
 
-	/* mark all the block for rehashing */
-	for (i = 0; i < blockmax; ++i) {
+	/* mark all the block for rehashing, a run of blocks with the same info at time */
+	for (i = 0; i < blockmax; i += count) {
 		snapraid_info info;
 
 		/* if it's unused */
-		info = info_get(&state->infoarr, i);
+		info = info_get_run(&state->infoarr, i, blockmax, &count);
 		if (info == 0) {
 			/* skip it */
 			continue;
@@ -85,7 +86,7 @@ void state_rehash(struct snapraid_state* state)
 		info = info_set_rehash(info);
 
 		/* save it */
-		info_set(&state->infoarr, i, info);
+		info_set_range(&state->infoarr, i, i + count, info);
 	}
 
 	/* save the new content file */
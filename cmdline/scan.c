@@ -44,7 +44,7 @@ struct snapraid_scan {
 	unsigned count_move; /**< Files with a different name, but equal inode, size and timestamp in the same disk. */
 	unsigned count_restore; /**< Files with equal name, size and timestamp, but different inode. */
 	unsigned count_change; /**< Files with same name, but different size and/or timestamp. */
-	unsigned count_copy; /**< Files new, with same name size and timestamp of a file in a different disk. */
+	unsigned count_copy; /**< Files new, with same name (or first block) size and timestamp of a file in a different disk. */
 	unsigned count_insert; /**< Files new. */
 	unsigned count_remove; /**< Files removed. */
 
@@ -305,6 +305,9 @@ static void scan_file_allocate(struct snapraid_scan* scan, struct snapraid_file*
 		/* store in the disk map, after invalidating all the other blocks */
 		fs_allocate(disk, parity_pos, file, i);
 
+		/* the parity has to be updated at this position */
+		state_dirty_set(state, parity_pos);
+
 		/* set the new free position */
 		disk->first_free_block = parity_pos + 1;
 	}
@@ -385,6 +388,9 @@ static void scan_file_deallocate(struct snapraid_scan* scan, struct snapraid_fil
 
 		/* set the block as deleted */
 		block_state_set(block, BLOCK_STATE_DELETED);
+
+		/* the parity has to be updated at this position */
+		state_dirty_set(state, fs_file2par_get(disk, file, i));
 	}
 
 	/* mark the file as deleted */
@@ -517,6 +523,97 @@ static int file_is_full_hashed_and_stable(struct snapraid_state* state, struct s
 	return 1;
 }
 
+/**
+ * Compute the hash of the first block of a file.
+ * Return -1 if the file cannot be read.
+ */
+static int scan_file_first_hash(struct snapraid_scan* scan, const char* sub, data_off_t size, unsigned char* digest)
+{
+	struct snapraid_state* state = scan->state;
+	struct snapraid_disk* disk = scan->disk;
+	char path[PATH_MAX];
+	unsigned read_size;
+	void* buffer;
+	int f;
+	int ret;
+
+	read_size = state->block_size;
+	if (read_size > size)
+		read_size = size;
+
+	pathprint(path, sizeof(path), "%s%s", disk->dir, sub);
+
+	f = open(path, O_RDONLY | O_BINARY);
+	if (f == -1) {
+		/* LCOV_EXCL_START */
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	buffer = malloc_nofail(state->block_size);
+
+	ret = read(f, buffer, read_size);
+	if (ret < 0 || (unsigned)ret != read_size) {
+		/* LCOV_EXCL_START */
+		free(buffer);
+		close(f);
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	memhash(state->hash, state->hashseed, digest, buffer, read_size);
+
+	free(buffer);
+
+	ret = close(f);
+	if (ret != 0) {
+		/* LCOV_EXCL_START */
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	return 0;
+}
+
+/**
+ * Search a file with the same stamp, but with any name, in all the disks.
+ *
+ * If a hash is specified, the file must also have the first block matching it.
+ */
+static struct snapraid_file* scan_file_search_by_stamp(struct snapraid_scan* scan, struct snapraid_file* file, const unsigned char* digest, struct snapraid_disk** other_disk_ptr)
+{
+	struct snapraid_state* state = scan->state;
+	tommy_uint32_t hash = file_stamp_hash(file->size, file->mtime_sec, file->mtime_nsec);
+	tommy_node* i;
+
+	for (i = state->disklist; i != 0; i = i->next) {
+		struct snapraid_disk* other_disk = i->data;
+		tommy_hashdyn_node* j;
+
+		stamp_lock(other_disk);
+		for (j = tommy_hashdyn_bucket(&other_disk->stampset, hash); j != 0; j = j->next) {
+			struct snapraid_file* other_file = j->data;
+
+			if (file_stamp_compare(file, other_file) != 0)
+				continue;
+
+			if (!file_is_full_hashed_and_stable(state, other_disk, other_file))
+				continue;
+
+			if (digest && memcmp(digest, fs_file2block_get(other_file, 0)->hash, BLOCK_HASH_SIZE) != 0)
+				continue;
+
+			stamp_unlock(other_disk);
+
+			*other_disk_ptr = other_disk;
+			return other_file;
+		}
+		stamp_unlock(other_disk);
+	}
+
+	return 0;
+}
+
 /**
  * Refresh the file info.
  *
@@ -1076,6 +1173,42 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 		}
 	}
 
+	/* if copy detection is enabled, and no copy was found with the same name */
+	/* search for a file with only the same stamp in all the disks, */
+	/* to detect files renamed and moved to another disk at the same time */
+	/* as the stamp alone is weaker, also verify that the first block matches */
+	/* this is done only with a valid nanosecond time stamp, to keep the reads rare */
+	if (!state->opt.force_nocopy
+		&& !is_file_reported
+		&& file->mtime_nsec != 0 && file->mtime_nsec != STAT_NSEC_INVALID
+	) {
+		struct snapraid_disk* other_disk;
+		struct snapraid_file* other_file;
+		unsigned char digest[HASH_MAX];
+
+		/* read the first block only if there is at least a candidate */
+		if (scan_file_search_by_stamp(scan, file, 0, &other_disk) != 0
+			&& scan_file_first_hash(scan, sub, file->size, digest) == 0
+		) {
+			other_file = scan_file_search_by_stamp(scan, file, digest, &other_disk);
+			if (other_file) {
+				/* assume that the file is a copy, and reuse the hash */
+				/* note that sync still verifies all the hashes when reading the data */
+				file_copy(other_file, file);
+
+				++scan->count_copy;
+
+				log_tag("scan:copy:%s:%s:%s:%s\n", other_disk->name, esc_tag(other_file->sub, esc_buffer), disk->name, esc_tag(file->sub, esc_buffer_alt));
+				if (is_diff) {
+					msg_info("copy %s -> %s\n", fmt_term(other_disk, other_file->sub, esc_buffer), fmt_term(disk, file->sub, esc_buffer_alt));
+				}
+
+				/* mark it as reported */
+				is_file_reported = 1;
+			}
+		}
+	}
+
 	/* if not yet reported, do it now */
 	/* we postpone this to avoid to print two times the copied files */
 	if (!is_file_reported) {
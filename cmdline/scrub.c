@@ -36,6 +36,16 @@ struct snapraid_rehash {
 	struct snapraid_block* block;
 };
 
+/**
+ * Block read and waiting to be hashed.
+ */
+struct snapraid_pending {
+	struct snapraid_task* task; /**< Task with the block read. */
+	unsigned diskcur; /**< Disk of the block. */
+	int file_is_unsynced; /**< If the file is not synced, and errors are expected. */
+	unsigned char hash[HASH_MAX]; /**< Hash of the block read. */
+};
+
 /**
  * Scrub plan to use.
  */
@@ -45,6 +55,7 @@ struct snapraid_plan {
 	time_t timelimit; /**< Time limit. Valid only with SCRUB_AUTO. */
 	block_off_t lastlimit; /**< Number of blocks allowed with time exactly at ::timelimit. */
 	block_off_t countlast; /**< Counter of blocks with time exactly at ::timelimit. */
+	uint64_t deadline; /**< Time in ms at which to stop the scrub. 0 for no limit. */
 };
 
 /**
@@ -249,6 +260,11 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	struct snapraid_handle* handle;
 	void* rehandle_alloc;
 	struct snapraid_rehash* rehandle;
+	struct snapraid_pending* pending;
+	unsigned pending_count;
+	void** hash_digest;
+	void** hash_src;
+	size_t* hash_size;
 	unsigned diskmax;
 	block_off_t blockcur;
 	unsigned j;
@@ -268,6 +284,7 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	unsigned waiting_mac;
 	char esc_buffer[ESC_MAX];
 	bit_vect_t* block_enabled;
+	int time_limit_reached;
 
 	/* maps the disks to handles */
 	handle = handle_mapping(state, &diskmax);
@@ -275,12 +292,22 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	/* rehash buffers */
 	rehandle = malloc_nofail_align(diskmax * sizeof(struct snapraid_rehash), &rehandle_alloc);
 
+	/* blocks to hash, all together for each stripe */
+	pending = malloc_nofail(diskmax * sizeof(struct snapraid_pending));
+	hash_digest = malloc_nofail(diskmax * sizeof(void*));
+	hash_src = malloc_nofail(diskmax * sizeof(void*));
+	hash_size = malloc_nofail(diskmax * sizeof(size_t));
+
 	/* we need 1 * data + 2 * parity */
 	buffermax = diskmax + 2 * state->level;
 
 	/* initialize the io threads */
 	io_init(&io, state, state->opt.io_cache, buffermax, scrub_data_reader, handle, diskmax, scrub_parity_reader, 0, parity_handle, state->level);
 
+	/* limit the read speed to not disturb other disk users */
+	if (state->scrub_limit != 0)
+		io_limit(&io, state->scrub_limit);
+
 	/* possibly waiting disks */
 	waiting_mac = diskmax > RAID_PARITY_MAX ? diskmax : RAID_PARITY_MAX;
 	waiting_map = malloc_nofail(waiting_mac * sizeof(unsigned));
@@ -288,6 +315,7 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	error = 0;
 	silent_error = 0;
 	io_error = 0;
+	time_limit_reached = 0;
 
 	msg_progress("Selecting...\n");
 
@@ -336,6 +364,15 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 		if (blockcur >= blockmax)
 			break;
 
+		/* stop before this block if the time limit is reached */
+		/* the blocks not scrubbed keep their old time, and they are the first in the next plan */
+		if ((plan->deadline != 0 && tick_ms() >= plan->deadline)
+			|| (state->opt.force_time_limit_at != 0 && countpos >= state->opt.force_time_limit_at)
+		) {
+			time_limit_reached = 1;
+			break;
+		}
+
 		/* until now is scheduling */
 		state_usage_sched(state);
 
@@ -358,16 +395,17 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 		/* if we have to use the old hash */
 		rehash = info_get_rehash(info);
 
+		/* no block to hash */
+		pending_count = 0;
+
 		/* for each disk, process the block */
 		for (j = 0; j < diskmax; ++j) {
 			struct snapraid_task* task;
 			int read_size;
-			unsigned char hash[HASH_MAX];
 			struct snapraid_block* block;
 			int file_is_unsynced;
 			struct snapraid_disk* disk;
 			struct snapraid_file* file;
-			block_off_t file_pos;
 			unsigned diskcur;
 
 			/* if the file on this disk is synced */
@@ -387,7 +425,6 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 			disk = task->disk;
 			block = task->block;
 			file = task->file;
-			file_pos = task->file_pos;
 			read_size = task->read_size;
 
 			/* by default no rehash in case of "continue" */
@@ -461,19 +498,47 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 
 			countsize += read_size;
 
-			/* now compute the hash */
-			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer[diskcur], read_size);
-
-				/* compute the new hash, and store it */
+			/* the hash is computed later, together with the other disks */
+			if (rehash)
 				rehandle[diskcur].block = block;
-				memhash(state->hash, state->hashseed, rehandle[diskcur].hash, buffer[diskcur], read_size);
-			} else {
-				memhash(state->hash, state->hashseed, hash, buffer[diskcur], read_size);
-			}
+			pending[pending_count].task = task;
+			pending[pending_count].diskcur = diskcur;
+			pending[pending_count].file_is_unsynced = file_is_unsynced;
+			++pending_count;
+		}
+
+		/* until now is misc */
+		state_usage_misc(state);
 
-			/* until now is hash */
-			state_usage_hash(state);
+		/* now compute the hashes of all the blocks read */
+		for (j = 0; j < pending_count; ++j) {
+			struct snapraid_task* task = pending[j].task;
+			hash_digest[j] = pending[j].hash;
+			hash_src[j] = buffer[pending[j].diskcur];
+			hash_size[j] = task->read_size;
+		}
+		if (rehash) {
+			memhash_multi(state->prevhash, state->prevhashseed, hash_digest, hash_src, hash_size, pending_count);
+
+			/* compute the new hash, and store it */
+			for (j = 0; j < pending_count; ++j)
+				hash_digest[j] = rehandle[pending[j].diskcur].hash;
+			memhash_multi(state->hash, state->hashseed, hash_digest, hash_src, hash_size, pending_count);
+		} else {
+			memhash_multi(state->hash, state->hashseed, hash_digest, hash_src, hash_size, pending_count);
+		}
+
+		/* until now is hash */
+		state_usage_hash(state);
+
+		/* compare the hashes */
+		for (j = 0; j < pending_count; ++j) {
+			struct snapraid_task* task = pending[j].task;
+			struct snapraid_block* block = task->block;
+			struct snapraid_disk* disk = task->disk;
+			struct snapraid_file* file = task->file;
+			block_off_t file_pos = task->file_pos;
+			unsigned char* hash = pending[j].hash;
 
 			if (block_has_updated_hash(block)) {
 				/* compare the hash */
@@ -483,7 +548,7 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 					log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u/%u\n", blockcur, disk->name, esc_tag(file->sub, esc_buffer), file_pos, diff, BLOCK_HASH_SIZE * 8);
 
 					/* it's a silent error only if we are dealing with synced files */
-					if (file_is_unsynced) {
+					if (pending[j].file_is_unsynced) {
 						++error;
 						error_on_this_block = 1;
 					} else {
@@ -491,7 +556,6 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 						++silent_error;
 						silent_error_on_this_block = 1;
 					}
-					continue;
 				}
 			}
 		}
@@ -565,12 +629,24 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 		/* if we have read all the data required and it's correct, proceed with the parity check */
 		if (!error_on_this_block && !silent_error_on_this_block && !io_error_on_this_block) {
 
-			/* compute the parity */
-			raid_gen(diskmax, state->level, state->block_size, buffer);
+			int parity_mask;
+
+			/* verify the parity read, without computing it in full */
+			parity_mask = raid_gen_verify(diskmax, state->level, state->block_size, buffer);
+
+			/* ignore the levels without parity, as their buffer contains garbage */
+			for (l = 0; l < state->level; ++l) {
+				if (!buffer_recov[l])
+					parity_mask &= ~(1 << l);
+			}
+
+			/* compute the parity only to report the differences */
+			if (parity_mask != 0)
+				raid_gen(diskmax, state->level, state->block_size, buffer);
 
 			/* compare the parity */
 			for (l = 0; l < state->level; ++l) {
-				if (buffer_recov[l] && memcmp(buffer[diskmax + l], buffer_recov[l], state->block_size) != 0) {
+				if (buffer_recov[l] && (parity_mask & (1 << l)) != 0 && memcmp(buffer[diskmax + l], buffer_recov[l], state->block_size) != 0) {
 					unsigned diff = memdiff(buffer[diskmax + l], buffer_recov[l], state->block_size);
 
 					log_tag("parity_error:%u:%s: Data error, diff bits %u/%u\n", blockcur, lev_config_name(l), diff, state->block_size * 8);
@@ -649,6 +725,9 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 
 	state_progress_end(state, countpos, countmax, countsize);
 
+	if (time_limit_reached)
+		msg_status("Time limit reached. The next scrub continues from the oldest blocks left.\n");
+
 	state_usage_print(state);
 
 	if (error || silent_error || io_error) {
@@ -677,6 +756,8 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	log_tag("summary:error_file:%u\n", error);
 	log_tag("summary:error_io:%u\n", io_error);
 	log_tag("summary:error_data:%u\n", silent_error);
+	if (time_limit_reached)
+		log_tag("summary:time_limit:%u\n", countmax - countpos);
 	if (error + silent_error + io_error == 0)
 		log_tag("summary:exit:ok\n");
 	else
@@ -703,10 +784,17 @@ bail:
 
 	free(handle);
 	free(rehandle_alloc);
+	free(pending);
+	free(hash_digest);
+	free(hash_src);
+	free(hash_size);
 	free(waiting_map);
 	io_done(&io);
 	free(block_enabled);
 
+	/* collapse the info chunks now with all the same info */
+	info_compact(&state->infoarr);
+
 	if (state->opt.expect_recoverable) {
 		if (error + silent_error + io_error == 0)
 			return -1;
@@ -741,14 +829,20 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 	int ret;
 	struct snapraid_parity_handle parity_handle[LEV_MAX];
 	struct snapraid_plan ps;
-	time_t* timemap;
+	struct snapraid_timehist timehist;
 	unsigned error;
 	time_t now;
 	unsigned l;
+	unsigned j;
 
 	/* get the present time */
 	now = time(0);
 
+	/* the time limit also includes the planning */
+	ps.deadline = 0;
+	if (state->opt.time_limit != 0)
+		ps.deadline = tick_ms() + state->opt.time_limit * 60000ULL;
+
 	msg_progress("Initializing...\n");
 
 	if ((plan == SCRUB_BAD || plan == SCRUB_NEW || plan == SCRUB_FULL)
@@ -797,22 +891,22 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 	}
 
 	/* identify the time limit */
-	/* we sort all the block times, and we identify the time limit for which we reach the quota */
+	/* we get all the block times sorted, and we identify the time limit for which we reach the quota */
 	/* this allow to process first the oldest blocks */
-	timemap = malloc_nofail(blockmax * sizeof(time_t));
+	timehist_init(&timehist);
 
-	/* copy the info in the temp vector */
-	count = 0;
+	/* collect the info in the histogram */
 	log_tag("block_count:%u\n", blockmax);
-	for (i = 0; i < blockmax; ++i) {
-		snapraid_info info = info_get(&state->infoarr, i);
+	for (i = 0; i < blockmax; i += count) {
+		snapraid_info info = info_get_run(&state->infoarr, i, blockmax, &count);
 
 		/* skip unused blocks */
 		if (info == 0)
 			continue;
 
-		timemap[count++] = info_get_time(info);
+		timehist_insert(&timehist, info_get_time(info), count);
 	}
+	count = timehist.count;
 
 	if (!count) {
 		/* LCOV_EXCL_START */
@@ -822,52 +916,46 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 	}
 
 	/* sort it */
-	qsort(timemap, count, sizeof(time_t), time_compare);
+	timehist_sort(&timehist);
 
 	/* output the info map */
-	i = 0;
 	log_tag("info_count:%u\n", count);
-	while (i < count) {
-		unsigned j = i + 1;
-		while (j < count && timemap[i] == timemap[j])
-			++j;
-		log_tag("info_time:%" PRIu64 ":%u\n", (uint64_t)timemap[i], j - i);
-		i = j;
-	}
+	for (j = 0; j < timehist.map_max; ++j)
+		log_tag("info_time:%" PRIu64 ":%u\n", (uint64_t)timehist.map[j]->time, timehist.map[j]->count);
 
 	/* compute the limits from count/recentlimit */
 	if (ps.plan == SCRUB_AUTO) {
-		/* no more than the full count */
-		if (countlimit > count)
-			countlimit = count;
-
-		/* decrease until we reach the specific recentlimit */
-		while (countlimit > 0 && timemap[countlimit - 1] > recentlimit)
-			--countlimit;
-
-		/* if there is something to scrub */
-		if (countlimit > 0) {
-			/* get the most recent time we want to scrub */
-			ps.timelimit = timemap[countlimit - 1];
-
-			/* count how many entries for this exact time we have to scrub */
-			/* if the blocks have all the same time, we end with countlimit == lastlimit */
-			ps.lastlimit = 1;
-			while (countlimit > ps.lastlimit && timemap[countlimit - ps.lastlimit - 1] == ps.timelimit)
-				++ps.lastlimit;
-		} else {
-			/* if nothing to scrub, disable also other limits */
-			ps.timelimit = 0;
-			ps.lastlimit = 0;
+		/* if nothing to scrub, keep also the other limits disabled */
+		ps.timelimit = 0;
+		ps.lastlimit = 0;
+
+		/* take the oldest times until we reach the quota or the specific recentlimit */
+		/* the most recent time taken is the time limit, and we count how many */
+		/* entries for this exact time we have to scrub */
+		/* if the blocks have all the same time, we end with countlimit == lastlimit */
+		count = 0;
+		for (j = 0; j < timehist.map_max && count < countlimit; ++j) {
+			struct snapraid_timecount* entry = timehist.map[j];
+
+			if (entry->time > recentlimit)
+				break;
+
+			ps.timelimit = entry->time;
+			ps.lastlimit = countlimit - count;
+			if (ps.lastlimit > entry->count)
+				ps.lastlimit = entry->count;
+			count += ps.lastlimit;
 		}
 
+		/* no more than the blocks taken */
+		countlimit = count;
+
 		log_tag("count_limit:%u\n", countlimit);
 		log_tag("time_limit:%" PRIu64 "\n", (uint64_t)ps.timelimit);
 		log_tag("last_limit:%u\n", ps.lastlimit);
 	}
 
-	/* free the temp vector */
-	free(timemap);
+	timehist_done(&timehist);
 
 	/* open the file for reading */
 	for (l = 0; l < state->level; ++l) {
@@ -253,6 +253,53 @@ static void test_hash(void)
 	free(seed_alloc);
 }
 
+#define HASH_MULTI_COUNT 11 /* enough to have a group of four buffers, and some left */
+
+static void test_hash_multi(void)
+{
+	unsigned i;
+	unsigned k;
+	unsigned char seed[HASH_MAX];
+	unsigned char* buffer;
+	unsigned char digest[HASH_MULTI_COUNT][HASH_MAX];
+	unsigned char digest_one[HASH_MAX];
+	void* digest_map[HASH_MULTI_COUNT];
+	void* src_map[HASH_MULTI_COUNT];
+	size_t size_map[HASH_MULTI_COUNT];
+	unsigned kind[] = { HASH_MURMUR3, HASH_SPOOKY2, HASH_METRO };
+
+	buffer = malloc_nofail(HASH_MULTI_COUNT * HASH_TEST_MAX);
+
+	for (i = 0; i < HASH_MAX; ++i)
+		seed[i] = i * 7;
+
+	for (i = 0; i < HASH_MULTI_COUNT * HASH_TEST_MAX; ++i)
+		buffer[i] = i * 13 + i / HASH_TEST_MAX;
+
+	/* mix full size buffers, with buffers ending with a partial block */
+	for (i = 0; i < HASH_MULTI_COUNT; ++i) {
+		digest_map[i] = digest[i];
+		src_map[i] = buffer + i * HASH_TEST_MAX;
+		size_map[i] = i % 3 == 1 ? HASH_TEST_MAX - 1 - i : HASH_TEST_MAX;
+	}
+
+	for (k = 0; k < sizeof(kind) / sizeof(kind[0]); ++k) {
+		memhash_multi(kind[k], seed, digest_map, src_map, size_map, HASH_MULTI_COUNT);
+
+		for (i = 0; i < HASH_MULTI_COUNT; ++i) {
+			memhash(kind[k], seed, digest_one, src_map[i], size_map[i]);
+			if (memcmp(digest_one, digest[i], HASH_MAX) != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Failed multi hash test\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+		}
+	}
+
+	free(buffer);
+}
+
 struct crc_test_vector {
 	const char* data;
 	int len;
@@ -580,6 +627,7 @@ void selftest(void)
 	}
 
 	test_hash();
+	test_hash_multi();
 	test_crc32c();
 	test_tommy();
 	if (raid_selftest() != 0) {
@@ -63,6 +63,7 @@ void usage(void)
 	printf("  " SWITCH_GETOPT_LONG("-e, --filter-error    ", "-e") "  Process only files with errors\n");
 	printf("  " SWITCH_GETOPT_LONG("-p, --plan PLAN       ", "-p") "  Define a scrub plan or percentage\n");
 	printf("  " SWITCH_GETOPT_LONG("-o, --older-than DAYS ", "-o") "  Process only the older part of the array\n");
+	printf("  " SWITCH_GETOPT_LONG("-t, --time-limit MIN  ", "-t") "  Stop the scrub after the specified minutes\n");
 	printf("  " SWITCH_GETOPT_LONG("-i, --import DIR      ", "-i") "  Import deleted files\n");
 	printf("  " SWITCH_GETOPT_LONG("-l, --log FILE        ", "-l") "  Log file. Default none\n");
 	printf("  " SWITCH_GETOPT_LONG("-a, --audit-only      ", "-a") "  Check only file data and not parity\n");
@@ -309,6 +310,7 @@ void config(char* conf, size_t conf_size, const char* argv0)
 #define OPT_TEST_SKIP_SPACE_HOLDER 303
 #define OPT_TEST_FORMAT 304
 #define OPT_TEST_SKIP_MULTI_SCAN 305
+#define OPT_TEST_FORCE_TIME_LIMIT_AT 306
 
 #if HAVE_GETOPT_LONG
 struct option long_options[] = {
@@ -321,6 +323,7 @@ struct option long_options[] = {
 	{ "percentage", 1, 0, 'p' }, /* legacy name for --plan */
 	{ "plan", 1, 0, 'p' },
 	{ "older-than", 1, 0, 'o' },
+	{ "time-limit", 1, 0, 't' },
 	{ "start", 1, 0, 'S' },
 	{ "count", 1, 0, 'B' },
 	{ "error-limit", 1, 0, 'L' },
@@ -480,11 +483,14 @@ struct option long_options[] = {
 	/* Skip thread in disk scan */
 	{ "test-skip-multi-scan", 0, 0, OPT_TEST_SKIP_MULTI_SCAN },
 
+	/* Force the scrub time limit at the specified block */
+	{ "test-force-time-limit-at", 1, 0, OPT_TEST_FORCE_TIME_LIMIT_AT },
+
 	{ 0, 0, 0, 0 }
 };
 #endif
 
-#define OPTIONS "c:f:d:mebp:o:S:B:L:i:l:ZEUDNFRahTC:vqHVG"
+#define OPTIONS "c:f:d:mebp:o:t:S:B:L:i:l:ZEUDNFRahTC:vqHVG"
 
 volatile int global_interrupt = 0;
 
@@ -673,6 +679,15 @@ int main(int argc, char* argv[])
 				/* LCOV_EXCL_STOP */
 			}
 			break;
+		case 't' :
+			opt.time_limit = strtoul(optarg, &e, 10);
+			if (!e || *e || opt.time_limit == 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid number of minutes '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			break;
 		case 'S' :
 			blockstart = strtoul(optarg, &e, 0);
 			if (!e || *e) {
@@ -937,6 +952,9 @@ int main(int argc, char* argv[])
 		case OPT_TEST_SKIP_MULTI_SCAN :
 			opt.skip_multi_scan = 1;
 			break;
+		case OPT_TEST_FORCE_TIME_LIMIT_AT :
+			opt.force_time_limit_at = atoi(optarg);
+			break;
 		default :
 			/* LCOV_EXCL_START */
 			log_fatal("Unknown option '%c'\n", (char)c);
@@ -948,6 +966,7 @@ int main(int argc, char* argv[])
 	os_init(opt.force_scan_winfind);
 	raid_init();
 	crc32c_init();
+	memhash_init();
 
 	if (speedtest != 0) {
 		speed(period);
@@ -1082,6 +1101,18 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	switch (operation) {
+	case OPERATION_SCRUB :
+		break;
+	default :
+		if (opt.time_limit != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("You cannot use -t, --time-limit with the '%s' command\n", command);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
 	if (opt.force_full && opt.force_nocopy) {
 		/* LCOV_EXCL_START */
 		log_fatal("You cannot use the -F, --force-full and -N, --force-nocopy options simultaneously\n");
@@ -1223,6 +1254,12 @@ int main(int argc, char* argv[])
 	case OPERATION_SYNC :
 	case OPERATION_SCRUB :
 	case OPERATION_DRY :
+#if HAVE_DIRECT_IO_DEFAULT
+		/* the data is read only once, so bypass the cache */
+		/* falling back to it where direct access is refused */
+		if (opt.file_mode == ADVISE_DEFAULT)
+			opt.file_mode = ADVISE_DIRECT;
+#endif
 		break;
 #endif
 	default:
@@ -1490,7 +1527,7 @@ int main(int argc, char* argv[])
 			if (import_timestamp != 0)
 				state_search(&state, import_timestamp);
 			if (import_content != 0)
-				state_import(&state, import_content);
+				state_import(&state, import_content, operation == OPERATION_FIX);
 
 			/* import from all the array */
 			if (!state.opt.force_nocopy)
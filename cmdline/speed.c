@@ -83,6 +83,9 @@ void speed(int period)
 	int64_t dt;
 	int i, j;
 	unsigned char digest[HASH_MAX];
+	unsigned char digest_multi[TEST_COUNT][HASH_MAX];
+	void* digest_map[TEST_COUNT];
+	size_t size_map[TEST_COUNT];
 	unsigned char seed[HASH_MAX];
 	int id[RAID_PARITY_MAX];
 	int ip[RAID_PARITY_MAX];
@@ -110,6 +113,12 @@ void speed(int period)
 	for (i = 0; i < HASH_MAX; ++i)
 		seed[i] = i;
 
+	/* multi hash buffers */
+	for (i = 0; i < nd; ++i) {
+		digest_map[i] = digest_multi[i];
+		size_map[i] = size;
+	}
+
 	/* basic disks and parity mapping */
 	for (i = 0; i < RAID_PARITY_MAX; ++i) {
 		id[i] = i;
@@ -217,6 +226,7 @@ void speed(int period)
 	printf("%8s", "murmur3");
 	printf("%8s", "spooky2");
 	printf("%8s", "metro");
+	printf("%8s", "multi");
 	printf("\n");
 
 	printf("%8s", "hash");
@@ -254,6 +264,13 @@ void speed(int period)
 			memhash(HASH_METRO, seed, digest, v[j], size);
 	} SPEED_STOP
 
+	printf("%8" PRIu64, ds / dt);
+	fflush(stdout);
+
+	SPEED_START {
+		memhash_multi(HASH_SPOOKY2, seed, digest_map, v, size_map, nd);
+	} SPEED_STOP
+
 	printf("%8" PRIu64, ds / dt);
 	printf("\n");
 	printf("\n");
@@ -733,7 +750,7 @@ void speed(int period)
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
 			/* +1 to avoid GEN1 optimized case */
-			raid_rec1_int8(1, id, ip + 1, nd, size, v);
+			raid_rec1_int8(0, 1, id, ip + 1, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -745,7 +762,7 @@ void speed(int period)
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
 				/* +1 to avoid GEN1 optimized case */
-				raid_rec1_ssse3(1, id, ip + 1, nd, size, v);
+				raid_rec1_ssse3(0, 1, id, ip + 1, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -756,7 +773,7 @@ void speed(int period)
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
 				/* +1 to avoid GEN1 optimized case */
-				raid_rec1_avx2(1, id, ip + 1, nd, size, v);
+				raid_rec1_avx2(0, 1, id, ip + 1, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -772,7 +789,7 @@ void speed(int period)
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
 			/* +1 to avoid GEN2 optimized case */
-			raid_rec2_int8(2, id, ip + 1, nd, size, v);
+			raid_rec2_int8(0, 2, id, ip + 1, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -784,7 +801,7 @@ void speed(int period)
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
 				/* +1 to avoid GEN2 optimized case */
-				raid_rec2_ssse3(2, id, ip + 1, nd, size, v);
+				raid_rec2_ssse3(0, 2, id, ip + 1, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -795,7 +812,7 @@ void speed(int period)
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
 				/* +1 to avoid GEN1 optimized case */
-				raid_rec2_avx2(2, id, ip + 1, nd, size, v);
+				raid_rec2_avx2(0, 2, id, ip + 1, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -810,7 +827,7 @@ void speed(int period)
 
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(3, id, ip, nd, size, v);
+			raid_recX_int8(0, 3, id, ip, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -821,7 +838,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(3, id, ip, nd, size, v);
+				raid_recX_ssse3(0, 3, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -831,7 +848,7 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(3, id, ip, nd, size, v);
+				raid_recX_avx2(0, 3, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -846,7 +863,7 @@ void speed(int period)
 
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(4, id, ip, nd, size, v);
+			raid_recX_int8(0, 4, id, ip, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -857,7 +874,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(4, id, ip, nd, size, v);
+				raid_recX_ssse3(0, 4, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -867,7 +884,7 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(4, id, ip, nd, size, v);
+				raid_recX_avx2(0, 4, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -882,7 +899,7 @@ void speed(int period)
 
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(5, id, ip, nd, size, v);
+			raid_recX_int8(0, 5, id, ip, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -893,7 +910,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(5, id, ip, nd, size, v);
+				raid_recX_ssse3(0, 5, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -903,7 +920,7 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(5, id, ip, nd, size, v);
+				raid_recX_avx2(0, 5, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -918,7 +935,7 @@ void speed(int period)
 
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(6, id, ip, nd, size, v);
+			raid_recX_int8(0, 6, id, ip, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -929,7 +946,7 @@ void speed(int period)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(6, id, ip, nd, size, v);
+				raid_recX_ssse3(0, 6, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -939,7 +956,7 @@ void speed(int period)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(6, id, ip, nd, size, v);
+				raid_recX_avx2(0, 6, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -160,3 +160,141 @@ void SpookyHash128(const void* data, size_t size, const uint8_t* seed, uint8_t*
 	util_write64(digest + 8, h1);
 }
 
+
+#if HAVE_AVX2 && defined(CONFIG_X86_64)
+/*
+ * Mix step for the AVX2 multi-buffer implementation.
+ *
+ * The state s0...s11 is kept in the registers ymm0...ymm11, with one buffer
+ * for each 64 bits lane, and the data is read from the transposed copy.
+ * It's the same operation of one line of the Mix() macro.
+ */
+#define MixStepAVX2(i, a, b, c, e, f, r) \
+	asm volatile ("vpaddq %0,%%ymm" #a ",%%ymm" #a : : "m" (data[i * 4])); \
+	asm volatile ("vpxor %ymm" #c ",%ymm" #b ",%ymm" #b); \
+	asm volatile ("vpxor %ymm" #a ",%ymm" #e ",%ymm" #e); \
+	asm volatile ("vpsllq $" #r ",%ymm" #a ",%ymm12"); \
+	asm volatile ("vpsrlq $(64-" #r "),%ymm" #a ",%ymm" #a); \
+	asm volatile ("vpor %ymm12,%ymm" #a ",%ymm" #a); \
+	asm volatile ("vpaddq %ymm" #f ",%ymm" #e ",%ymm" #e);
+
+/*
+ * Computes the SpookyHash128 of four buffers of the same size at once.
+ *
+ * The main body is computed with the four states in parallel in the AVX2
+ * registers, the tail and the finalization are computed for each buffer
+ * like in SpookyHash128(), producing exactly the same digests.
+ */
+void SpookyHash128x4_avx2(const void** void_data, size_t size, const uint8_t* seed, uint8_t** digest)
+{
+	const uint8_t* ptr[4];
+	uint64_t data[sc_numVars * 4];
+	uint64_t state[sc_numVars * 4];
+	uint64_t seed0, seed1, seedc;
+	size_t nblocks;
+	size_t i;
+	unsigned j;
+	unsigned k;
+
+	for (k = 0; k < 4; ++k)
+		ptr[k] = void_data[k];
+
+	seed0 = util_read64(seed + 0);
+	seed1 = util_read64(seed + 8);
+	seedc = sc_const;
+
+	nblocks = size / sc_blockSize;
+
+	asm volatile ("vpbroadcastq %0,%%ymm0" : : "m" (seed0));
+	asm volatile ("vpbroadcastq %0,%%ymm1" : : "m" (seed1));
+	asm volatile ("vpbroadcastq %0,%%ymm2" : : "m" (seedc));
+	asm volatile ("vmovdqa %ymm0,%ymm3");
+	asm volatile ("vmovdqa %ymm1,%ymm4");
+	asm volatile ("vmovdqa %ymm2,%ymm5");
+	asm volatile ("vmovdqa %ymm0,%ymm6");
+	asm volatile ("vmovdqa %ymm1,%ymm7");
+	asm volatile ("vmovdqa %ymm2,%ymm8");
+	asm volatile ("vmovdqa %ymm0,%ymm9");
+	asm volatile ("vmovdqa %ymm1,%ymm10");
+	asm volatile ("vmovdqa %ymm2,%ymm11");
+
+	/* body */
+	for (i = 0; i < nblocks * sc_blockSize; i += sc_blockSize) {
+		/* transpose the block, putting the same word of each buffer in a register */
+		for (j = 0; j < sc_blockSize; j += 16) {
+			asm volatile ("vmovdqu %0,%%xmm12" : : "m" (ptr[0][i + j]));
+			asm volatile ("vinserti128 $1,%0,%%ymm12,%%ymm12" : : "m" (ptr[2][i + j]));
+			asm volatile ("vmovdqu %0,%%xmm13" : : "m" (ptr[1][i + j]));
+			asm volatile ("vinserti128 $1,%0,%%ymm13,%%ymm13" : : "m" (ptr[3][i + j]));
+			asm volatile ("vpunpcklqdq %ymm13,%ymm12,%ymm14");
+			asm volatile ("vpunpckhqdq %ymm13,%ymm12,%ymm12");
+			asm volatile ("vmovdqu %%ymm14,%0" : "=m" (data[j / 2]));
+			asm volatile ("vmovdqu %%ymm12,%0" : "=m" (data[j / 2 + 4]));
+		}
+
+		MixStepAVX2(0, 0, 2, 10, 11, 1, 11);
+		MixStepAVX2(1, 1, 3, 11, 0, 2, 32);
+		MixStepAVX2(2, 2, 4, 0, 1, 3, 43);
+		MixStepAVX2(3, 3, 5, 1, 2, 4, 31);
+		MixStepAVX2(4, 4, 6, 2, 3, 5, 17);
+		MixStepAVX2(5, 5, 7, 3, 4, 6, 28);
+		MixStepAVX2(6, 6, 8, 4, 5, 7, 39);
+		MixStepAVX2(7, 7, 9, 5, 6, 8, 57);
+		MixStepAVX2(8, 8, 10, 6, 7, 9, 55);
+		MixStepAVX2(9, 9, 11, 7, 8, 10, 54);
+		MixStepAVX2(10, 10, 0, 8, 9, 11, 22);
+		MixStepAVX2(11, 11, 1, 9, 10, 0, 46);
+	}
+
+	asm volatile ("vmovdqu %%ymm0,%0" : "=m" (state[0 * 4]));
+	asm volatile ("vmovdqu %%ymm1,%0" : "=m" (state[1 * 4]));
+	asm volatile ("vmovdqu %%ymm2,%0" : "=m" (state[2 * 4]));
+	asm volatile ("vmovdqu %%ymm3,%0" : "=m" (state[3 * 4]));
+	asm volatile ("vmovdqu %%ymm4,%0" : "=m" (state[4 * 4]));
+	asm volatile ("vmovdqu %%ymm5,%0" : "=m" (state[5 * 4]));
+	asm volatile ("vmovdqu %%ymm6,%0" : "=m" (state[6 * 4]));
+	asm volatile ("vmovdqu %%ymm7,%0" : "=m" (state[7 * 4]));
+	asm volatile ("vmovdqu %%ymm8,%0" : "=m" (state[8 * 4]));
+	asm volatile ("vmovdqu %%ymm9,%0" : "=m" (state[9 * 4]));
+	asm volatile ("vmovdqu %%ymm10,%0" : "=m" (state[10 * 4]));
+	asm volatile ("vmovdqu %%ymm11,%0" : "=m" (state[11 * 4]));
+
+	/* clobbers all the registers used, see raid_sse_end() */
+	asm volatile ("" : : : "%xmm0", "%xmm1", "%xmm2", "%xmm3");
+	asm volatile ("" : : : "%xmm4", "%xmm5", "%xmm6", "%xmm7");
+	asm volatile ("" : : : "%xmm8", "%xmm9", "%xmm10", "%xmm11");
+	asm volatile ("" : : : "%xmm12", "%xmm13", "%xmm14", "%xmm15");
+	asm volatile ("vzeroupper" : : : "memory");
+
+	for (k = 0; k < 4; ++k) {
+		uint64_t h0, h1, h2, h3, h4, h5, h6, h7, h8, h9, h10, h11;
+		uint64_t buf[sc_numVars];
+		size_t size_remainder;
+
+		h0 = state[0 * 4 + k];
+		h1 = state[1 * 4 + k];
+		h2 = state[2 * 4 + k];
+		h3 = state[3 * 4 + k];
+		h4 = state[4 * 4 + k];
+		h5 = state[5 * 4 + k];
+		h6 = state[6 * 4 + k];
+		h7 = state[7 * 4 + k];
+		h8 = state[8 * 4 + k];
+		h9 = state[9 * 4 + k];
+		h10 = state[10 * 4 + k];
+		h11 = state[11 * 4 + k];
+
+		/* tail */
+		size_remainder = size - nblocks * sc_blockSize;
+		memcpy(buf, ptr[k] + nblocks * sc_blockSize, size_remainder);
+		memset(((uint8_t*)buf) + size_remainder, 0, sc_blockSize - size_remainder);
+		((uint8_t*)buf)[sc_blockSize - 1] = size_remainder;
+
+		/* finalization */
+		End(buf, h0, h1, h2, h3, h4, h5, h6, h7, h8, h9, h10, h11);
+
+		util_write64(digest[k] + 0, h0);
+		util_write64(digest[k] + 8, h1);
+	}
+}
+#endif
@@ -139,6 +139,7 @@ void state_init(struct snapraid_state* state)
 	memset(&state->opt, 0, sizeof(state->opt));
 	state->filter_hidden = 0;
 	state->autosave = 0;
+	state->scrub_limit = 0;
 	state->need_write = 0;
 	state->checked_read = 0;
 	state->block_size = 256 * KIBI; /* default 256 KiB */
@@ -182,7 +183,9 @@ void state_init(struct snapraid_state* state)
 	tommy_hashdyn_init(&state->importset);
 	tommy_hashdyn_init(&state->previmportset);
 	tommy_hashdyn_init(&state->searchset);
-	tommy_arrayblkof_init(&state->infoarr, sizeof(snapraid_info));
+	info_init(&state->infoarr);
+	state->dirty_vect = 0;
+	state->dirty_max = 0;
 }
 
 void state_done(struct snapraid_state* state)
@@ -196,7 +199,8 @@ void state_done(struct snapraid_state* state)
 	tommy_hashdyn_done(&state->importset);
 	tommy_hashdyn_done(&state->previmportset);
 	tommy_hashdyn_done(&state->searchset);
-	tommy_arrayblkof_done(&state->infoarr);
+	info_done(&state->infoarr);
+	free(state->dirty_vect);
 }
 
 /**
@@ -1148,6 +1152,35 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 
 			/* convert to GB */
 			state->autosave *= GIGA;
+		} else if (strcmp(tag, "scrublimit") == 0) {
+			char* e;
+
+			ret = sgetlasttok(f, buffer, sizeof(buffer));
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'scrublimit' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (!*buffer) {
+				/* LCOV_EXCL_START */
+				log_fatal("Empty 'scrublimit' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			state->scrub_limit = strtoul(buffer, &e, 0);
+
+			if (!e || *e) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'scrublimit' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			/* convert to MB/s */
+			state->scrub_limit *= MEGA;
 		} else if (tag[0] == 0) {
 			/* allow empty lines */
 		} else if (tag[0] == '#') {
@@ -1244,6 +1277,8 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 		log_tag("share:%s\n", state->share);
 	if (state->autosave != 0)
 		log_tag("autosave:%" PRIu64 "\n", state->autosave);
+	if (state->scrub_limit != 0)
+		log_tag("scrublimit:%" PRIu64 "\n", state->scrub_limit);
 	for (i = tommy_list_head(&state->filterlist); i != 0; i = i->next) {
 		char out[PATH_MAX];
 		struct snapraid_filter* filter = i->data;
@@ -2033,6 +2068,10 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 					/* set the parity association */
 					fs_allocate(disk, v_pos, file, v_idx);
 
+					/* keep track of the positions with invalid parity */
+					if (block_has_invalid_parity(block))
+						state_dirty_set(state, v_pos);
+
 					/* go to the next block */
 					++v_idx;
 					++v_pos;
@@ -2118,10 +2157,10 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 					info = 0;
 				}
 
-				while (v_count) {
-					/* insert the info in the array */
-					info_set(&state->infoarr, v_pos, info);
+				/* insert the info in the array */
+				info_set_range(&state->infoarr, v_pos, v_pos + v_count, info);
 
+				while (v_count) {
 					/* ensure that an info is present only for used positions */
 					if (fs_info_is_required(state, v_pos)) {
 						if (!info) {
@@ -2221,6 +2260,9 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 						/* insert the block in the block array */
 						fs_allocate(disk, v_pos, deleted, v_idx);
 
+						/* deleted blocks always have invalid parity */
+						state_dirty_set(state, v_pos);
+
 						/* go to next block */
 						++v_pos;
 						++v_idx;
@@ -3270,15 +3312,9 @@ static void* state_write_thread(void* arg)
 		time_t t;
 		unsigned flag;
 
-		info = info_get(&state->infoarr, begin);
-
-		/* find the end of run of blocks */
-		end = begin + 1;
-		while (end < blockmax
-			&& info == info_get(&state->infoarr, end)
-		) {
-			++end;
-		}
+		/* get the run of blocks with the same info */
+		info = info_get_run(&state->infoarr, begin, blockmax, &end);
+		end += begin;
 
 		sputb32(end - begin, f);
 
@@ -4671,6 +4707,20 @@ void state_usage_hash(struct snapraid_state* state)
 	state->tick_last = now;
 }
 
+void state_usage_hash_worker(struct snapraid_state* state, struct snapraid_disk* disk, uint64_t delta)
+{
+	/* move the time from the disk waiting to the computations */
+	if (disk->tick >= delta)
+		disk->tick -= delta;
+	else
+		disk->tick = 0;
+	if (state->tick_io >= delta)
+		state->tick_io -= delta;
+	else
+		state->tick_io = 0;
+	state->tick_hash += delta;
+}
+
 void state_usage_file(struct snapraid_state* state, struct snapraid_disk* disk, struct snapraid_file* file)
 {
 	(void)state;
@@ -4741,6 +4791,51 @@ void state_fscheck(struct snapraid_state* state, const char* ope)
 	}
 }
 
+void state_dirty_set(struct snapraid_state* state, block_off_t pos)
+{
+	/* grow the vector if required */
+	if (pos >= state->dirty_max) {
+		bit_vect_t* vect;
+		block_off_t max;
+		size_t size;
+
+		/* double the size to have an amortized constant time */
+		max = state->dirty_max * 2;
+		if (max < 1024 * BIT_VECT_SIZE)
+			max = 1024 * BIT_VECT_SIZE;
+		while (max <= pos)
+			max *= 2;
+
+		size = bit_vect_size(state->dirty_max);
+
+		vect = calloc_nofail(1, bit_vect_size(max));
+		if (state->dirty_vect)
+			memcpy(vect, state->dirty_vect, size);
+		free(state->dirty_vect);
+
+		state->dirty_vect = vect;
+		state->dirty_max = max;
+	}
+
+	bit_vect_set(state->dirty_vect, pos);
+}
+
+block_off_t state_dirty_next(struct snapraid_state* state, block_off_t pos, block_off_t blockmax)
+{
+	block_off_t dirtymax;
+
+	/* positions over the vector are never dirty */
+	dirtymax = blockmax;
+	if (dirtymax > state->dirty_max)
+		dirtymax = state->dirty_max;
+
+	pos = bit_vect_next(state->dirty_vect, pos, dirtymax);
+	if (pos >= dirtymax)
+		return blockmax;
+
+	return pos;
+}
+
 void generate_configuration(const char* path)
 {
 	struct snapraid_state state;
@@ -85,6 +85,7 @@ struct snapraid_option {
 	int force_nocopy; /**< Force dangerous operations of syncing files without using copy detection. */
 	int force_full; /**< Force a full parity update. */
 	int force_realloc; /**< Force a full reallocation and parity update. */
+	unsigned time_limit; /**< Time limit in minutes for scrub. 0 for no limit. */
 	int expect_unrecoverable; /**< Expect presence of unrecoverable error in checking or fixing. */
 	int expect_recoverable; /**< Expect presence of recoverable error in checking. */
 	int skip_device; /**< Skip devices matching checks. */
@@ -109,6 +110,7 @@ struct snapraid_option {
 	int force_scan_winfind; /**< Force the use of FindFirst/Next in Windows to list directories. */
 	int force_progress; /**< Force the use of the progress status. */
 	unsigned force_autosave_at; /**< Force autosave at the specified block. */
+	unsigned force_time_limit_at; /**< Force the scrub time limit after the specified number of blocks. */
 	int fake_device; /**< Fake device data. */
 	int no_warnings; /**< Remove some warning messages. */
 	int expected_missing; /**< If missing files are expected and should not be reported. */
@@ -126,6 +128,7 @@ struct snapraid_state {
 	struct snapraid_option opt; /**< Setup options. */
 	int filter_hidden; /**< Filter out hidden files. */
 	uint64_t autosave; /**< Autosave after the specified amount of data. 0 to disable. */
+	uint64_t scrub_limit; /**< Maximum read speed of each disk in scrub, in bytes per second. 0 to disable. */
 	int need_write; /**< If the state is changed. */
 	int checked_read; /**< If the state was read and checked. */
 	uint32_t block_size; /**< Block size in bytes. */
@@ -151,7 +154,19 @@ struct snapraid_state {
 	tommy_hashdyn importset; /**< Hashtable by hash of all the import blocks. */
 	tommy_hashdyn previmportset; /**< Hashtable by prevhash of all the import blocks. Valid only if we are in a rehash state. */
 	tommy_hashdyn searchset; /**< Hashtable by timestamp of all the search files. */
-	tommy_arrayblkof infoarr; /**< Block information array. */
+	struct snapraid_infoarr infoarr; /**< Block information array. */
+
+	/**
+	 * Dirty positions.
+	 *
+	 * Bit vector of the parity positions with at least one block with invalid parity,
+	 * meaning CHG, REP or DELETED. It's rebuilt from the block states stored in
+	 * the content file, and it's updated by scan when allocating or deleting files.
+	 * It's a superset of the positions that sync has to process, as the bits are never
+	 * cleared until the next run.
+	 */
+	bit_vect_t* dirty_vect;
+	block_off_t dirty_max; /**< Number of positions allocated in ::dirty_vect. */
 
 	/**
 	 * Cumulative time used for computations.
@@ -349,6 +364,12 @@ void state_usage_sched(struct snapraid_state* state);
 void state_usage_raid(struct snapraid_state* state);
 void state_usage_hash(struct snapraid_state* state);
 
+/**
+ * Add the hash time measured by a worker thread.
+ * The time is already counted as waiting for the disk, as the worker hashes after reading.
+ */
+void state_usage_hash_worker(struct snapraid_state* state, struct snapraid_disk* disk, uint64_t delta);
+
 /**
  * Set the last file used
  */
@@ -375,6 +396,17 @@ void state_usage_print(struct snapraid_state* state);
  */
 void state_fscheck(struct snapraid_state* state, const char* ope);
 
+/**
+ * Mark the parity position as dirty.
+ */
+void state_dirty_set(struct snapraid_state* state, block_off_t pos);
+
+/**
+ * Get the first dirty parity position starting from the specified one.
+ * Return ::blockmax if no other dirty position is present.
+ */
+block_off_t state_dirty_next(struct snapraid_state* state, block_off_t pos, block_off_t blockmax);
+
 /****************************************************************************/
 /* misc */
 
@@ -48,7 +48,7 @@ int state_status(struct snapraid_state* state)
 {
 	block_off_t blockmax;
 	block_off_t i;
-	time_t* timemap;
+	struct snapraid_timehist timehist;
 	time_t now;
 	block_off_t bad;
 	block_off_t bad_first;
@@ -278,8 +278,8 @@ int state_status(struct snapraid_state* state)
 	log_tag("summary:best_hash:%s\n", hash_config_name(state->besthash));
 	log_flush();
 
-	/* copy the info a temp vector, and count bad/rehash/unsynced blocks */
-	timemap = malloc_nofail(blockmax * sizeof(time_t));
+	/* collect the info in the histogram, and count bad/rehash/unsynced blocks */
+	timehist_init(&timehist);
 	bad = 0;
 	bad_first = 0;
 	bad_last = 0;
@@ -335,7 +335,8 @@ int state_status(struct snapraid_state* state)
 				scrub_time |= TIME_NEW;
 			}
 
-			timemap[count++] = scrub_time;
+			timehist_insert(&timehist, scrub_time, 1);
+			++count;
 		}
 
 		if (state->opt.gui) {
@@ -354,31 +355,27 @@ int state_status(struct snapraid_state* state)
 
 	if (!count) {
 		log_fatal("The array is empty.\n");
-		free(timemap);
+		timehist_done(&timehist);
 		return 0;
 	}
 
 	/* sort the info to get the time info */
-	qsort(timemap, count, sizeof(time_t), time_compare);
+	timehist_sort(&timehist);
 
 	/* output the info map */
-	i = 0;
 	log_tag("info_count:%u\n", count);
-	while (i < count) {
-		unsigned j = i + 1;
-		while (j < count && timemap[i] == timemap[j])
-			++j;
-		if ((timemap[i] & TIME_NEW) == 0) {
-			log_tag("info_time:%" PRIu64 ":%u:scrubbed\n", (uint64_t)timemap[i], j - i);
+	for (i = 0; i < timehist.map_max; ++i) {
+		struct snapraid_timecount* entry = timehist.map[i];
+		if ((entry->time & TIME_NEW) == 0) {
+			log_tag("info_time:%" PRIu64 ":%u:scrubbed\n", (uint64_t)entry->time, entry->count);
 		} else {
-			log_tag("info_time:%" PRIu64 ":%u:new\n", (uint64_t)(timemap[i] & ~TIME_NEW), j - i);
+			log_tag("info_time:%" PRIu64 ":%u:new\n", (uint64_t)(entry->time & ~TIME_NEW), entry->count);
 		}
-		i = j;
 	}
 
-	oldest = timemap[0];
-	median = timemap[count / 2];
-	newest = timemap[count - 1];
+	oldest = timehist.map[0]->time;
+	median = timehist_at(&timehist, count / 2);
+	newest = timehist.map[timehist.map_max - 1]->time;
 	dayoldest = day_ago(oldest, now);
 	daymedian = day_ago(median, now);
 	daynewest = day_ago(newest, now);
@@ -394,11 +391,11 @@ int state_status(struct snapraid_state* state)
 
 		step_scrubbed = 0;
 		step_new = 0;
-		while (barpos < count && timemap[barpos] <= limit) {
-			if ((timemap[barpos] & TIME_NEW) != 0)
-				++step_new;
+		while (barpos < timehist.map_max && timehist.map[barpos]->time <= limit) {
+			if ((timehist.map[barpos]->time & TIME_NEW) != 0)
+				step_new += timehist.map[barpos]->count;
 			else
-				++step_scrubbed;
+				step_scrubbed += timehist.map[barpos]->count;
 			++barpos;
 		}
 
@@ -523,8 +520,7 @@ int state_status(struct snapraid_state* state)
 		printf("No error detected.\n");
 	}
 
-	/* free the temp vector */
-	free(timemap);
+	timehist_done(&timehist);
 
 	return 0;
 }
@@ -1263,6 +1263,35 @@ int advise_read(struct advise_struct* advise, int f, data_off_t offset, data_off
 	return 0;
 }
 
+int advise_direct_fallback(struct advise_struct* advise, int f)
+{
+	if (advise->mode != ADVISE_DIRECT || errno != EINVAL)
+		return -1;
+
+	if (f != -1) {
+#if HAVE_DIRECT_IO && defined(F_SETFL)
+		int flags;
+
+		/* remove O_DIRECT from the already opened file */
+		flags = fcntl(f, F_GETFL);
+		if (flags == -1 || fcntl(f, F_SETFL, flags & ~O_DIRECT) != 0) {
+			/* LCOV_EXCL_START */
+			errno = EINVAL;
+			return -1;
+			/* LCOV_EXCL_STOP */
+		}
+#else
+		/* the file cannot be changed, and the error is real */
+		return -1;
+#endif
+	}
+
+	/* use the cache, but discard it as done in the default mode */
+	advise->mode = ADVISE_DISCARD;
+
+	return 0;
+}
+
 /****************************************************************************/
 /* memory */
 
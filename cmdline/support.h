@@ -365,6 +365,18 @@ int advise_open(struct advise_struct* advise, int f);
 int advise_write(struct advise_struct* advise, int f, data_off_t offset, data_off_t size);
 int advise_read(struct advise_struct* advise, int f, data_off_t offset, data_off_t size);
 
+/**
+ * Fallback from direct to cached access after an EINVAL error.
+ *
+ * Direct access may be refused by the filesystem, at open or at the first
+ * read or write not respecting its alignment.
+ * If the mode is ADVISE_DIRECT and errno is EINVAL, the mode is changed to
+ * ADVISE_DISCARD, and if the file is already opened, O_DIRECT is removed from it.
+ * \param f The file handle, or -1 if the open failed.
+ * \return 0 if the operation has to be retried, or -1 if it's a real error.
+ */
+int advise_direct_fallback(struct advise_struct* advise, int f);
+
 /****************************************************************************/
 /* memory */
 
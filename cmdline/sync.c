@@ -28,18 +28,403 @@
 /****************************************************************************/
 /* hash */
 
+/**
+ * Shared context of all the pre-hash workers.
+ */
+struct snapraid_hash_pool {
+	struct snapraid_state* state; /**< State used. */
+	int is_thread; /**< If the workers are running in separated threads. */
+
+#if HAVE_THREAD
+	/**
+	 * Mutex protecting the members below, when using threads.
+	 */
+	thread_mutex_t mutex;
+
+	/**
+	 * Condition signaled by the workers at each block processed,
+	 * and at their termination.
+	 */
+	thread_cond_t progress;
+#endif
+
+	unsigned running; /**< Number of workers still running. */
+	int stop; /**< If all the workers have to stop. */
+	block_off_t lastpos; /**< Last position processed. */
+	block_off_t countpos; /**< Number of blocks processed. */
+	block_off_t countmax; /**< Number of blocks to process. */
+	data_off_t countsize; /**< Size of the data processed. */
+};
+
+/**
+ * Pre-hash worker of a single data disk.
+ */
+struct snapraid_hash {
+	struct snapraid_hash_pool* pool; /**< Shared context. */
+	struct snapraid_handle* handle; /**< Handle of the disk. */
+#if HAVE_THREAD
+	thread_id_t thread; /**< Thread used for hashing the disk. */
+#endif
+	block_off_t blockstart; /**< First position to process. */
+	block_off_t blockmax; /**< Last position to process. */
+	void* buffer; /**< Buffer for reading. */
+	void* buffer_alloc;
+
+	/**
+	 * Results of the worker.
+	 */
+	unsigned error;
+	unsigned silent_error;
+	unsigned io_error;
+	int skip_sync; /**< If the next sync has to be skipped. */
+	int need_write; /**< If the state was changed. */
+	int bail; /**< If the worker stopped for an unrecoverable error. */
+};
+
+/**
+ * Check if the workers have to stop.
+ */
+static int hash_stop(struct snapraid_hash_pool* pool)
+{
+	int stop;
+
+#if HAVE_THREAD
+	if (pool->is_thread) {
+		thread_mutex_lock(&pool->mutex);
+		stop = pool->stop;
+		thread_mutex_unlock(&pool->mutex);
+		return stop;
+	}
+#endif
+
+	stop = pool->stop;
+
+	return stop;
+}
+
+/**
+ * Request all the workers to stop.
+ */
+static void hash_bail(struct snapraid_hash_pool* pool)
+{
+#if HAVE_THREAD
+	if (pool->is_thread) {
+		thread_mutex_lock(&pool->mutex);
+		pool->stop = 1;
+		thread_mutex_unlock(&pool->mutex);
+		return;
+	}
+#endif
+
+	pool->stop = 1;
+}
+
+/**
+ * Account a processed block.
+ *
+ * With threads, the progress is reported by the main thread.
+ */
+static void hash_progress(struct snapraid_hash_pool* pool, block_off_t pos, data_off_t size)
+{
+#if HAVE_THREAD
+	if (pool->is_thread) {
+		thread_mutex_lock(&pool->mutex);
+		pool->lastpos = pos;
+		++pool->countpos;
+		pool->countsize += size;
+		thread_cond_signal_and_unlock(&pool->progress, &pool->mutex);
+		return;
+	}
+#endif
+
+	pool->lastpos = pos;
+	++pool->countpos;
+	pool->countsize += size;
+
+	if (state_progress(pool->state, 0, pos, pool->countpos, pool->countmax, pool->countsize)) {
+		/* LCOV_EXCL_START */
+		pool->stop = 1;
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+/**
+ * Terminate a worker.
+ */
+static void hash_exit(struct snapraid_hash_pool* pool)
+{
+#if HAVE_THREAD
+	if (pool->is_thread) {
+		thread_mutex_lock(&pool->mutex);
+		--pool->running;
+		thread_cond_signal_and_unlock(&pool->progress, &pool->mutex);
+		return;
+	}
+#endif
+
+	--pool->running;
+}
+
+static void* hash_disk(void* arg)
+{
+	struct snapraid_hash* hash = arg;
+	struct snapraid_hash_pool* pool = hash->pool;
+	struct snapraid_state* state = pool->state;
+	struct snapraid_handle* handle = hash->handle;
+	struct snapraid_disk* disk = handle->disk;
+	void* buffer = hash->buffer;
+	block_off_t blockmax = hash->blockmax;
+	block_off_t i;
+	int ret;
+	char esc_buffer[ESC_MAX];
+
+	for (i = state_dirty_next(state, hash->blockstart, blockmax); i < blockmax; i = state_dirty_next(state, i + 1, blockmax)) {
+		snapraid_info info;
+		int rehash;
+		struct snapraid_block* block;
+		int read_size;
+		unsigned char digest[HASH_MAX];
+		unsigned block_state;
+		struct snapraid_file* file;
+		block_off_t file_pos;
+
+		block = fs_par2block_find(disk, i);
+
+		/* get the state of the block */
+		block_state = block_state_get(block);
+
+		/* process REP and CHG blocks */
+		if (block_state != BLOCK_STATE_REP && block_state != BLOCK_STATE_CHG)
+			continue;
+
+		/* stop if requested by the other workers */
+		if (hash_stop(pool))
+			break;
+
+		/* get the file of this block */
+		file = fs_par2file_get(disk, i, &file_pos);
+
+		/* get block specific info */
+		info = info_get(&state->infoarr, i);
+
+		/* if we have to use the old hash */
+		rehash = info_get_rehash(info);
+
+		/* if the file is different than the current one, close it */
+		if (handle->file != 0 && handle->file != file) {
+			/* keep a pointer at the file we are going to close for error reporting */
+			struct snapraid_file* report = handle->file;
+			ret = handle_close(handle);
+			if (ret == -1) {
+				/* LCOV_EXCL_START */
+				/* This one is really an unexpected error, because we are only reading */
+				/* and closing a descriptor should never fail */
+				if (errno == EIO) {
+					log_tag("error:%u:%s:%s: Close EIO error. %s\n", i, disk->name, esc_tag(report->sub, esc_buffer), strerror(errno));
+					log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to sync.\n");
+					log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
+					log_fatal("Stopping at block %u\n", i);
+					++hash->io_error;
+					goto bail;
+				}
+
+				log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc_tag(report->sub, esc_buffer), strerror(errno));
+				log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to sync.\n");
+				log_fatal("Ensure that file '%s' can be accessed.\n", handle->path);
+				log_fatal("Stopping at block %u\n", i);
+				++hash->error;
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+		}
+
+		ret = handle_open(handle, file, state->file_mode, log_error, 0);
+		if (ret == -1) {
+			if (errno == EIO) {
+				/* LCOV_EXCL_START */
+				log_tag("error:%u:%s:%s: Open EIO error. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
+				log_fatal("DANGER! Unexpected input/output open error in a data disk, it isn't possible to sync.\n");
+				log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
+				log_fatal("Stopping at block %u\n", i);
+				++hash->io_error;
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (errno == ENOENT) {
+				log_tag("error:%u:%s:%s: Open ENOENT error. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
+				log_error("Missing file '%s'.\n", handle->path);
+				log_error("WARNING! You cannot modify data disk during a sync.\n");
+				log_error("Rerun the sync command when finished.\n");
+				++hash->error;
+				/* if the file is missing, it means that it was removed during sync */
+				/* this isn't a serious error, so we skip this block, and continue with others */
+				continue;
+			}
+
+			if (errno == EACCES) {
+				log_tag("error:%u:%s:%s: Open EACCES error. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
+				log_error("No access at file '%s'.\n", handle->path);
+				log_error("WARNING! Please fix the access permission in the data disk.\n");
+				log_error("Rerun the sync command when finished.\n");
+				++hash->error;
+				/* this isn't a serious error, so we skip this block, and continue with others */
+				continue;
+			}
+
+			/* LCOV_EXCL_START */
+			log_tag("error:%u:%s:%s: Open error. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
+			log_fatal("WARNING! Unexpected open error in a data disk, it isn't possible to sync.\n");
+			log_fatal("Ensure that file '%s' can be accessed.\n", handle->path);
+			log_fatal("Stopping to allow recovery. Try with 'snapraid check -f /%s'\n", fmt_poll(disk, file->sub, esc_buffer));
+			++hash->error;
+			goto bail;
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* check if the file is changed */
+		if (handle->st.st_size != file->size
+			|| handle->st.st_mtime != file->mtime_sec
+			|| STAT_NSEC(&handle->st) != file->mtime_nsec
+			|| handle->st.st_ino != file->inode
+		) {
+			log_tag("error:%u:%s:%s: Unexpected attribute change\n", i, disk->name, esc_tag(file->sub, esc_buffer));
+			if (handle->st.st_size != file->size) {
+				log_error("Unexpected size change at file '%s' from %" PRIu64 " to %" PRIu64 ".\n", handle->path, file->size, (uint64_t)handle->st.st_size);
+			} else if (handle->st.st_mtime != file->mtime_sec
+				|| STAT_NSEC(&handle->st) != file->mtime_nsec) {
+				log_error("Unexpected time change at file '%s' from %" PRIu64 ".%d to %" PRIu64 ".%d.\n", handle->path, file->mtime_sec, file->mtime_nsec, (uint64_t)handle->st.st_mtime, STAT_NSEC(&handle->st));
+			} else {
+				log_error("Unexpected inode change from %" PRIu64 " to %" PRIu64 " at file '%s'.\n", file->inode, (uint64_t)handle->st.st_ino, handle->path);
+			}
+			log_error("WARNING! You cannot modify files during a sync.\n");
+			log_error("Rerun the sync command when finished.\n");
+			++hash->error;
+			/* if the file is changed, it means that it was modified during sync */
+			/* this isn't a serious error, so we skip this block, and continue with others */
+			continue;
+		}
+
+		read_size = handle_read(handle, file_pos, buffer, state->block_size, log_fatal, 0);
+		if (read_size == -1) {
+			/* LCOV_EXCL_START */
+			if (errno == EIO) {
+				log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), file_pos, strerror(errno));
+				log_fatal("DANGER! Unexpected input/output read error in a data disk, it isn't possible to sync.\n");
+				log_fatal("Ensure that disk '%s' is sane and that file '%s' can be read.\n", disk->dir, handle->path);
+				log_fatal("Stopping at block %u\n", i);
+				++hash->io_error;
+				goto bail;
+			}
+
+			log_tag("error:%u:%s:%s: Read error at position %u. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), file_pos, strerror(errno));
+			log_fatal("WARNING! Unexpected read error in a data disk, it isn't possible to sync.\n");
+			log_fatal("Ensure that file '%s' can be read.\n", handle->path);
+			log_fatal("Stopping to allow recovery. Try with 'snapraid check -f /%s'\n", fmt_poll(disk, file->sub, esc_buffer));
+			++hash->error;
+			goto bail;
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* now compute the hash */
+		if (rehash) {
+			memhash(state->prevhash, state->prevhashseed, digest, buffer, read_size);
+		} else {
+			memhash(state->hash, state->hashseed, digest, buffer, read_size);
+		}
+
+		if (block_state == BLOCK_STATE_REP) {
+			/* compare the hash */
+			if (memcmp(digest, block->hash, BLOCK_HASH_SIZE) != 0) {
+				log_tag("error:%u:%s:%s: Unexpected data change\n", i, disk->name, esc_tag(file->sub, esc_buffer));
+				log_error("Data change at file '%s' at position '%u'\n", handle->path, file_pos);
+				log_error("WARNING! Unexpected data modification of a file without parity!\n");
+
+				if (file_flag_has(file, FILE_IS_COPY)) {
+					log_error("This file was detected as a copy of another file, or as the same file renamed\n");
+					log_error("or moved, with the same size and timestamp, but the file data isn't matching\n");
+					log_error("the assumed copy.\n");
+					log_error("If this is a false positive, and the files are expected to be different,\n");
+					log_error("you can 'sync' anyway using 'snapraid --force-nocopy sync'\n");
+				} else {
+					log_error("Try removing the file from the array and rerun the 'sync' command!\n");
+				}
+
+				/* block sync to allow a recovery before overwriting */
+				/* the parity needed to make such recovery */
+				hash->skip_sync = 1; /* avoid to run the next sync */
+
+				++hash->silent_error;
+				continue;
+			}
+		} else {
+			/* the only other case is BLOCK_STATE_CHG */
+			assert(block_state == BLOCK_STATE_CHG);
+
+			/* copy the hash in the block */
+			memcpy(block->hash, digest, BLOCK_HASH_SIZE);
+
+			/* and mark the block as hashed */
+			block_state_set(block, BLOCK_STATE_REP);
+
+			/* mark the state as needing write */
+			hash->need_write = 1;
+		}
+
+		/* count the number of processed block */
+		hash_progress(pool, i, read_size);
+	}
+
+	/* close the last file in the disk */
+	if (handle->file != 0) {
+		/* keep a pointer at the file we are going to close for error reporting */
+		struct snapraid_file* report = handle->file;
+		ret = handle_close(handle);
+		if (ret == -1) {
+			/* LCOV_EXCL_START */
+			/* This one is really an unexpected error, because we are only reading */
+			/* and closing a descriptor should never fail */
+			if (errno == EIO) {
+				log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockmax, disk->name, esc_tag(report->sub, esc_buffer), strerror(errno));
+				log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to sync.\n");
+				log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
+				log_fatal("Stopping at block %u\n", blockmax);
+				++hash->io_error;
+				goto bail;
+			}
+
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockmax, disk->name, esc_tag(report->sub, esc_buffer), strerror(errno));
+			log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to sync.\n");
+			log_fatal("Ensure that file '%s' can be accessed.\n", handle->path);
+			log_fatal("Stopping at block %u\n", blockmax);
+			++hash->error;
+			goto bail;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	hash_exit(pool);
+	return 0;
+
+bail:
+	/* stop all the other workers, the open files are closed by the caller */
+	hash->bail = 1;
+	hash_bail(pool);
+	hash_exit(pool);
+	return 0;
+}
+
 static int state_hash_process(struct snapraid_state* state, block_off_t blockstart, block_off_t blockmax, int* skip_sync)
 {
+	struct snapraid_hash_pool pool;
+	struct snapraid_hash* hash_map;
 	struct snapraid_handle* handle;
 	unsigned diskmax;
 	block_off_t i;
 	unsigned j;
-	void* buffer;
-	void* buffer_alloc;
-	data_off_t countsize;
-	block_off_t countpos;
 	block_off_t countmax;
 	int ret;
+	int bail;
 	unsigned error;
 	unsigned silent_error;
 	unsigned io_error;
@@ -48,14 +433,38 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 	/* maps the disks to handles */
 	handle = handle_mapping(state, &diskmax);
 
-	/* buffer for reading */
-	buffer = malloc_nofail_direct(state->block_size, &buffer_alloc);
-	if (!state->opt.skip_self)
-		mtest_vector(1, state->block_size, &buffer);
+	/* one worker for each disk */
+	hash_map = malloc_nofail(diskmax * sizeof(struct snapraid_hash));
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_hash* hash = &hash_map[j];
+
+		hash->pool = &pool;
+		hash->handle = &handle[j];
+		hash->blockstart = blockstart;
+		hash->blockmax = blockmax;
+		hash->error = 0;
+		hash->silent_error = 0;
+		hash->io_error = 0;
+		hash->skip_sync = 0;
+		hash->need_write = 0;
+		hash->bail = 0;
+		hash->buffer = 0;
+		hash->buffer_alloc = 0;
+
+		/* if no disk, nothing to check */
+		if (!handle[j].disk)
+			continue;
+
+		/* buffer for reading */
+		hash->buffer = malloc_nofail_direct(state->block_size, &hash->buffer_alloc);
+		if (!state->opt.skip_self)
+			mtest_vector(1, state->block_size, &hash->buffer);
+	}
 
 	error = 0;
 	silent_error = 0;
 	io_error = 0;
+	bail = 0;
 
 	/* first count the number of blocks to process */
 	countmax = 0;
@@ -66,7 +475,7 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 		if (!disk)
 			continue;
 
-		for (i = blockstart; i < blockmax; ++i) {
+		for (i = state_dirty_next(state, blockstart, blockmax); i < blockmax; i = state_dirty_next(state, i + 1, blockmax)) {
 			struct snapraid_block* block;
 			unsigned block_state;
 
@@ -83,265 +492,122 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 		}
 	}
 
+	pool.state = state;
+	pool.running = 0;
+	pool.stop = 0;
+	pool.lastpos = blockstart;
+	pool.countpos = 0;
+	pool.countmax = countmax;
+	pool.countsize = 0;
+
+	/* use threads, unless the io cache is disabled */
+#if HAVE_THREAD
+	pool.is_thread = state->opt.io_cache != 1;
+#else
+	pool.is_thread = 0;
+#endif
+
 	/* drop until now */
 	state_usage_waste(state);
 
-	countsize = 0;
-	countpos = 0;
 	if (!state_progress_begin(state, blockstart, blockmax, countmax))
 		goto end;
 
-	for (j = 0; j < diskmax; ++j) {
-		struct snapraid_disk* disk = handle[j].disk;
-
-		/* if no disk, nothing to check */
-		if (!disk)
-			continue;
-
-		for (i = blockstart; i < blockmax; ++i) {
-			snapraid_info info;
-			int rehash;
-			struct snapraid_block* block;
-			int read_size;
-			unsigned char hash[HASH_MAX];
-			unsigned block_state;
-			struct snapraid_file* file;
-			block_off_t file_pos;
-
-			block = fs_par2block_find(disk, i);
-
-			/* get the state of the block */
-			block_state = block_state_get(block);
+#if HAVE_THREAD
+	if (pool.is_thread) {
+		thread_mutex_init(&pool.mutex);
+		thread_cond_init(&pool.progress);
 
-			/* process REP and CHG blocks */
-			if (block_state != BLOCK_STATE_REP && block_state != BLOCK_STATE_CHG)
+		/* count all the threads before starting any of them */
+		/* as the running ones decrement the counter */
+		for (j = 0; j < diskmax; ++j) {
+			if (!handle[j].disk)
 				continue;
+			++pool.running;
+		}
 
-			/* get the file of this block */
-			file = fs_par2file_get(disk, i, &file_pos);
-
-			/* get block specific info */
-			info = info_get(&state->infoarr, i);
-
-			/* if we have to use the old hash */
-			rehash = info_get_rehash(info);
-
-			/* until now is misc */
-			state_usage_misc(state);
-
-			/* if the file is different than the current one, close it */
-			if (handle[j].file != 0 && handle[j].file != file) {
-				/* keep a pointer at the file we are going to close for error reporting */
-				struct snapraid_file* report = handle[j].file;
-				ret = handle_close(&handle[j]);
-				if (ret == -1) {
-					/* LCOV_EXCL_START */
-					/* This one is really an unexpected error, because we are only reading */
-					/* and closing a descriptor should never fail */
-					if (errno == EIO) {
-						log_tag("error:%u:%s:%s: Close EIO error. %s\n", i, disk->name, esc_tag(report->sub, esc_buffer), strerror(errno));
-						log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to sync.\n");
-						log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle[j].path);
-						log_fatal("Stopping at block %u\n", i);
-						++io_error;
-						goto bail;
-					}
-
-					log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc_tag(report->sub, esc_buffer), strerror(errno));
-					log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to sync.\n");
-					log_fatal("Ensure that file '%s' can be accessed.\n", handle[j].path);
-					log_fatal("Stopping at block %u\n", i);
-					++error;
-					goto bail;
-					/* LCOV_EXCL_STOP */
-				}
-			}
-
-			ret = handle_open(&handle[j], file, state->file_mode, log_error, 0);
-			if (ret == -1) {
-				if (errno == EIO) {
-					/* LCOV_EXCL_START */
-					log_tag("error:%u:%s:%s: Open EIO error. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
-					log_fatal("DANGER! Unexpected input/output open error in a data disk, it isn't possible to sync.\n");
-					log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle[j].path);
-					log_fatal("Stopping at block %u\n", i);
-					++io_error;
-					goto bail;
-					/* LCOV_EXCL_STOP */
-				}
+		/* start one thread for each disk, reading all the disks in parallel */
+		for (j = 0; j < diskmax; ++j) {
+			if (!handle[j].disk)
+				continue;
+			thread_create(&hash_map[j].thread, hash_disk, &hash_map[j]);
+		}
 
-				if (errno == ENOENT) {
-					log_tag("error:%u:%s:%s: Open ENOENT error. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
-					log_error("Missing file '%s'.\n", handle[j].path);
-					log_error("WARNING! You cannot modify data disk during a sync.\n");
-					log_error("Rerun the sync command when finished.\n");
-					++error;
-					/* if the file is missing, it means that it was removed during sync */
-					/* this isn't a serious error, so we skip this block, and continue with others */
-					continue;
-				}
+		/* report the progress until all the workers terminate */
+		thread_mutex_lock(&pool.mutex);
+		while (pool.running != 0) {
+			block_off_t lastpos;
+			block_off_t countpos;
+			data_off_t countsize;
+			int stop;
 
-				if (errno == EACCES) {
-					log_tag("error:%u:%s:%s: Open EACCES error. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
-					log_error("No access at file '%s'.\n", handle[j].path);
-					log_error("WARNING! Please fix the access permission in the data disk.\n");
-					log_error("Rerun the sync command when finished.\n");
-					++error;
-					/* this isn't a serious error, so we skip this block, and continue with others */
-					continue;
-				}
+			thread_cond_wait(&pool.progress, &pool.mutex);
 
-				/* LCOV_EXCL_START */
-				log_tag("error:%u:%s:%s: Open error. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
-				log_fatal("WARNING! Unexpected open error in a data disk, it isn't possible to sync.\n");
-				log_fatal("Ensure that file '%s' can be accessed.\n", handle[j].path);
-				log_fatal("Stopping to allow recovery. Try with 'snapraid check -f /%s'\n", fmt_poll(disk, file->sub, esc_buffer));
-				++error;
-				goto bail;
-				/* LCOV_EXCL_STOP */
-			}
+			lastpos = pool.lastpos;
+			countpos = pool.countpos;
+			countsize = pool.countsize;
+			stop = pool.stop;
 
-			/* check if the file is changed */
-			if (handle[j].st.st_size != file->size
-				|| handle[j].st.st_mtime != file->mtime_sec
-				|| STAT_NSEC(&handle[j].st) != file->mtime_nsec
-				|| handle[j].st.st_ino != file->inode
-			) {
-				log_tag("error:%u:%s:%s: Unexpected attribute change\n", i, disk->name, esc_tag(file->sub, esc_buffer));
-				if (handle[j].st.st_size != file->size) {
-					log_error("Unexpected size change at file '%s' from %" PRIu64 " to %" PRIu64 ".\n", handle[j].path, file->size, (uint64_t)handle[j].st.st_size);
-				} else if (handle[j].st.st_mtime != file->mtime_sec
-					|| STAT_NSEC(&handle[j].st) != file->mtime_nsec) {
-					log_error("Unexpected time change at file '%s' from %" PRIu64 ".%d to %" PRIu64 ".%d.\n", handle[j].path, file->mtime_sec, file->mtime_nsec, (uint64_t)handle[j].st.st_mtime, STAT_NSEC(&handle[j].st));
-				} else {
-					log_error("Unexpected inode change from %" PRIu64 " to %" PRIu64 " at file '%s'.\n", file->inode, (uint64_t)handle[j].st.st_ino, handle[j].path);
-				}
-				log_error("WARNING! You cannot modify files during a sync.\n");
-				log_error("Rerun the sync command when finished.\n");
-				++error;
-				/* if the file is changed, it means that it was modified during sync */
-				/* this isn't a serious error, so we skip this block, and continue with others */
-				continue;
-			}
+			thread_mutex_unlock(&pool.mutex);
 
-			read_size = handle_read(&handle[j], file_pos, buffer, state->block_size, log_fatal, 0);
-			if (read_size == -1) {
+			if (!stop && state_progress(state, 0, lastpos, countpos, countmax, countsize)) {
 				/* LCOV_EXCL_START */
-				if (errno == EIO) {
-					log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), file_pos, strerror(errno));
-					log_fatal("DANGER! Unexpected input/output read error in a data disk, it isn't possible to sync.\n");
-					log_fatal("Ensure that disk '%s' is sane and that file '%s' can be read.\n", disk->dir, handle[j].path);
-					log_fatal("Stopping at block %u\n", i);
-					++io_error;
-					goto bail;
-				}
-
-				log_tag("error:%u:%s:%s: Read error at position %u. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), file_pos, strerror(errno));
-				log_fatal("WARNING! Unexpected read error in a data disk, it isn't possible to sync.\n");
-				log_fatal("Ensure that file '%s' can be read.\n", handle[j].path);
-				log_fatal("Stopping to allow recovery. Try with 'snapraid check -f /%s'\n", fmt_poll(disk, file->sub, esc_buffer));
-				++error;
-				goto bail;
+				hash_bail(&pool);
 				/* LCOV_EXCL_STOP */
 			}
 
-			/* until now is disk */
-			state_usage_disk(state, handle, &j, 1);
-
-			state_usage_file(state, disk, file);
-
-			countsize += read_size;
-
-			/* now compute the hash */
-			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer, read_size);
-			} else {
-				memhash(state->hash, state->hashseed, hash, buffer, read_size);
-			}
-
-			/* until now is hash */
-			state_usage_hash(state);
-
-			if (block_state == BLOCK_STATE_REP) {
-				/* compare the hash */
-				if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
-					log_tag("error:%u:%s:%s: Unexpected data change\n", i, disk->name, esc_tag(file->sub, esc_buffer));
-					log_error("Data change at file '%s' at position '%u'\n", handle[j].path, file_pos);
-					log_error("WARNING! Unexpected data modification of a file without parity!\n");
-
-					if (file_flag_has(file, FILE_IS_COPY)) {
-						log_error("This file was detected as a copy of another file with the same name, size,\n");
-						log_error("and timestamp, but the file data isn't matching the assumed copy.\n");
-						log_error("If this is a false positive, and the files are expected to be different,\n");
-						log_error("you can 'sync' anyway using 'snapraid --force-nocopy sync'\n");
-					} else {
-						log_error("Try removing the file from the array and rerun the 'sync' command!\n");
-					}
-
-					/* block sync to allow a recovery before overwriting */
-					/* the parity needed to make such recovery */
-					*skip_sync = 1; /* avoid to run the next sync */
-
-					++silent_error;
-					continue;
-				}
-			} else {
-				/* the only other case is BLOCK_STATE_CHG */
-				assert(block_state == BLOCK_STATE_CHG);
-
-				/* copy the hash in the block */
-				memcpy(block->hash, hash, BLOCK_HASH_SIZE);
-
-				/* and mark the block as hashed */
-				block_state_set(block, BLOCK_STATE_REP);
-
-				/* mark the state as needing write */
-				state->need_write = 1;
-			}
+			thread_mutex_lock(&pool.mutex);
+		}
+		thread_mutex_unlock(&pool.mutex);
 
-			/* count the number of processed block */
-			++countpos;
+		/* wait for all threads to terminate */
+		for (j = 0; j < diskmax; ++j) {
+			void* retval;
 
-			/* progress */
-			if (state_progress(state, 0, i, countpos, countmax, countsize)) {
-				/* LCOV_EXCL_START */
-				*skip_sync = 1; /* avoid to run the next sync */
-				break;
-				/* LCOV_EXCL_STOP */
-			}
+			if (!handle[j].disk)
+				continue;
+			thread_join(hash_map[j].thread, &retval);
 		}
 
-		/* close the last file in the disk */
-		if (handle[j].file != 0) {
-			/* keep a pointer at the file we are going to close for error reporting */
-			struct snapraid_file* report = handle[j].file;
-			ret = handle_close(&handle[j]);
-			if (ret == -1) {
-				/* LCOV_EXCL_START */
-				/* This one is really an unexpected error, because we are only reading */
-				/* and closing a descriptor should never fail */
-				if (errno == EIO) {
-					log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockmax, disk->name, esc_tag(report->sub, esc_buffer), strerror(errno));
-					log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to sync.\n");
-					log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle[j].path);
-					log_fatal("Stopping at block %u\n", blockmax);
-					++io_error;
-					goto bail;
-				}
-
-				log_tag("error:%u:%s:%s: Close error. %s\n", blockmax, disk->name, esc_tag(report->sub, esc_buffer), strerror(errno));
-				log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to sync.\n");
-				log_fatal("Ensure that file '%s' can be accessed.\n", handle[j].path);
-				log_fatal("Stopping at block %u\n", blockmax);
-				++error;
-				goto bail;
-				/* LCOV_EXCL_STOP */
-			}
+		thread_cond_destroy(&pool.progress);
+		thread_mutex_destroy(&pool.mutex);
+	} else {
+#endif
+		/* process one disk after the other */
+		for (j = 0; j < diskmax && !pool.stop; ++j) {
+			if (!handle[j].disk)
+				continue;
+			++pool.running;
+			hash_disk(&hash_map[j]);
 		}
+#if HAVE_THREAD
 	}
+#endif
+
+	/* collect the results of all the workers */
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_hash* hash = &hash_map[j];
+
+		error += hash->error;
+		silent_error += hash->silent_error;
+		io_error += hash->io_error;
+		if (hash->skip_sync)
+			*skip_sync = 1;
+		if (hash->need_write)
+			state->need_write = 1;
+		if (hash->bail)
+			bail = 1;
+	}
+
+	if (bail)
+		goto bail;
+
+	/* if interrupted, don't run the next sync */
+	if (pool.stop)
+		*skip_sync = 1; /* LCOV_EXCL_LINE */
 
 end:
-	state_progress_end(state, countpos, countmax, countsize);
+	state_progress_end(state, pool.countpos, countmax, pool.countsize);
 
 	/* note that at this point no io_error is possible */
 	/* because at the first one we bail out */
@@ -354,7 +620,7 @@ end:
 		msg_status("%8u data errors\n", silent_error);
 	} else {
 		/* print the result only if processed something */
-		if (countpos != 0)
+		if (pool.countpos != 0)
 			msg_status("Everything OK\n");
 	}
 
@@ -376,7 +642,7 @@ bail:
 		struct snapraid_disk* disk = handle[j].disk;
 		ret = handle_close(&handle[j]);
 		if (ret == -1) {
-			log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Close error. %s\n", pool.lastpos, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
 			log_fatal("DANGER! Unexpected close error in a data disk.\n");
 			++error;
 			/* continue, as we are already exiting */
@@ -384,8 +650,10 @@ bail:
 	}
 
 finish:
+	for (j = 0; j < diskmax; ++j)
+		free(hash_map[j].buffer_alloc);
+	free(hash_map);
 	free(handle);
-	free(buffer_alloc);
 
 	if (error + io_error + silent_error != 0)
 		return -1;
@@ -473,6 +741,19 @@ static int block_is_enabled(struct snapraid_plan* plan, block_off_t i)
 	return 1;
 }
 
+/**
+ * Get the next position to check with block_is_enabled().
+ *
+ * Only the dirty positions may need a parity update, unless a full sync is requested.
+ */
+static block_off_t sync_next(struct snapraid_plan* plan, struct snapraid_state* state, block_off_t i, block_off_t blockmax)
+{
+	if (plan->force_full)
+		return i;
+
+	return state_dirty_next(state, i, blockmax);
+}
+
 static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_task* task)
 {
 	struct snapraid_io* io = worker->io;
@@ -624,6 +905,19 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 	/* store the path of the opened file */
 	pathcpy(task->path, sizeof(task->path), handle->path);
 
+	/* compute the hash here, and not in the main thread */
+	/* this allows to hash the next stripes of all the disks in parallel */
+	/* while the main thread is still computing and writing the parity */
+	/* note that the info vector is preallocated, and it's safe to read it */
+	task->tick_hash = tick();
+	if (info_get_rehash(info_get(&state->infoarr, blockcur))) {
+		memhash(state->prevhash, state->prevhashseed, task->hash, buffer, task->read_size);
+		memhash(state->hash, state->hashseed, task->rehash, buffer, task->read_size);
+	} else {
+		memhash(state->hash, state->hashseed, task->hash, buffer, task->read_size);
+	}
+	task->tick_hash = tick() - task->tick_hash;
+
 	task->state = TASK_STATE_DONE;
 }
 
@@ -693,6 +987,7 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 	unsigned waiting_mac;
 	char esc_buffer[ESC_MAX];
 	bit_vect_t* block_enabled;
+	struct raid_cache cache;
 
 	/* the sync process assumes that all the hashes are correct */
 	/* including the ones from CHG and DELETED blocks */
@@ -721,6 +1016,9 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 	memset(zero, 0, state->block_size);
 	raid_zero(zero);
 
+	/* the same failures are usually recovered in many blocks */
+	raid_cache_init(&cache);
+
 	failed = malloc_nofail(diskmax * sizeof(struct failed_struct));
 	failed_map = malloc_nofail(diskmax * sizeof(unsigned));
 
@@ -740,7 +1038,7 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 	plan.handle_map = handle;
 	plan.force_full = state->opt.force_full;
 	block_enabled = calloc_nofail(1, bit_vect_size(blockmax)); /* preinitialize to 0 */
-	for (blockcur = blockstart; blockcur < blockmax; ++blockcur) {
+	for (blockcur = sync_next(&plan, state, blockstart, blockmax); blockcur < blockmax; blockcur = sync_next(&plan, state, blockcur + 1, blockmax)) {
 		if (!block_is_enabled(&plan, blockcur))
 			continue;
 		bit_vect_set(block_enabled, blockcur);
@@ -762,6 +1060,19 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 
 	msg_progress("Syncing...\n");
 
+	/* allocate the info for all the positions, and expand the chunks to process */
+	/* the worker threads read it to select the hash to compute, */
+	/* and this ensures that the main thread never reallocates it */
+	info_grow(&state->infoarr, blockmax);
+	for (blockcur = blockstart; blockcur < blockmax; ++blockcur) {
+		if (bit_vect_test(block_enabled, blockcur)) {
+			info_expand(&state->infoarr, blockcur);
+
+			/* go to the last position of the chunk */
+			blockcur |= INFO_CHUNK - 1;
+		}
+	}
+
 	/* start all the worker threads */
 	io_start(&io, blockstart, blockmax, block_enabled);
 
@@ -932,22 +1243,19 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 				/* LCOV_EXCL_STOP */
 			}
 
+			/* account the hash computed by the worker */
+			state_usage_hash_worker(state, disk, task->tick_hash);
+
 			countsize += read_size;
 
-			/* now compute the hash */
+			/* get the hash already computed by the worker */
+			memcpy(hash, task->hash, HASH_MAX);
 			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer[diskcur], read_size);
-
-				/* compute the new hash, and store it */
+				/* store the new hash */
 				rehandle[diskcur].block = block;
-				memhash(state->hash, state->hashseed, rehandle[diskcur].hash, buffer[diskcur], read_size);
-			} else {
-				memhash(state->hash, state->hashseed, hash, buffer[diskcur], read_size);
+				memcpy(rehandle[diskcur].hash, task->rehash, HASH_MAX);
 			}
 
-			/* until now is hash */
-			state_usage_hash(state);
-
 			if (block_has_updated_hash(block)) {
 				/* compare the hash */
 				if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
@@ -958,8 +1266,9 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 						log_error("WARNING! Unexpected data modification of a file without parity!\n");
 
 						if (file_flag_has(file, FILE_IS_COPY)) {
-							log_error("This file was detected as a copy of another file with the same name, size,\n");
-							log_error("and timestamp, but the file data isn't matching the assumed copy.\n");
+							log_error("This file was detected as a copy of another file, or as the same file renamed\n");
+							log_error("or moved, with the same size and timestamp, but the file data isn't matching\n");
+							log_error("the assumed copy.\n");
 							log_error("If this is a false positive, and the files are expected to be different,\n");
 							log_error("you can 'sync' anyway using 'snapraid --force-nocopy sync'\n");
 						} else {
@@ -1111,7 +1420,7 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 					/* note that this is a simple fix algorithm, that doesn't take into */
 					/* account the case of a wrong parity */
 					/* only 'fix' supports the most advanced fixing */
-					raid_rec(failed_mac, failed_map, diskmax, state->level, state->block_size, buffer);
+					raid_rec_cache(&cache, failed_mac, failed_map, diskmax, state->level, state->block_size, buffer);
 
 					/* until now is raid */
 					state_usage_raid(state);
@@ -1316,18 +1625,16 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 
 			/* before writing the new content file we ensure that */
 			/* the parity is really written flushing the disk cache */
-			for (l = 0; l < state->level; ++l) {
-				ret = parity_sync(&parity_handle[l]);
-				if (ret == -1) {
-					/* LCOV_EXCL_START */
-					log_tag("parity_error:%u:%s: Sync error\n", blockcur, lev_config_name(l));
-					log_fatal("DANGER! Unexpected sync error in %s disk.\n", lev_name(l));
-					log_fatal("Ensure that disk '%s' is sane.\n", lev_config_name(l));
-					log_fatal("Stopping at block %u\n", blockcur);
-					++error;
-					goto bail;
-					/* LCOV_EXCL_STOP */
-				}
+			ret = parity_sync_all(parity_handle, state->level, state->opt.io_cache != 1, &l);
+			if (ret == -1) {
+				/* LCOV_EXCL_START */
+				log_tag("parity_error:%u:%s: Sync error\n", blockcur, lev_config_name(l));
+				log_fatal("DANGER! Unexpected sync error in %s disk.\n", lev_name(l));
+				log_fatal("Ensure that disk '%s' is sane.\n", lev_config_name(l));
+				log_fatal("Stopping at block %u\n", blockcur);
+				++error;
+				goto bail;
+				/* LCOV_EXCL_STOP */
 			}
 
 			/* now we can safely write the content file */
@@ -1347,18 +1654,16 @@ end:
 
 	/* before returning we ensure that */
 	/* the parity is really written flushing the disk cache */
-	for (l = 0; l < state->level; ++l) {
-		ret = parity_sync(&parity_handle[l]);
-		if (ret == -1) {
-			/* LCOV_EXCL_START */
-			log_tag("parity_error:%u:%s: Sync error\n", blockcur, lev_config_name(l));
-			log_fatal("DANGER! Unexpected sync error in %s disk.\n", lev_name(l));
-			log_fatal("Ensure that disk '%s' is sane.\n", lev_config_name(l));
-			log_fatal("Stopping at block %u\n", blockcur);
-			++error;
-			goto bail;
-			/* LCOV_EXCL_STOP */
-		}
+	ret = parity_sync_all(parity_handle, state->level, state->opt.io_cache != 1, &l);
+	if (ret == -1) {
+		/* LCOV_EXCL_START */
+		log_tag("parity_error:%u:%s: Sync error\n", blockcur, lev_config_name(l));
+		log_fatal("DANGER! Unexpected sync error in %s disk.\n", lev_name(l));
+		log_fatal("Ensure that disk '%s' is sane.\n", lev_config_name(l));
+		log_fatal("Stopping at block %u\n", blockcur);
+		++error;
+		goto bail;
+		/* LCOV_EXCL_STOP */
 	}
 
 	if (error || silent_error || io_error) {
@@ -1421,6 +1726,9 @@ bail:
 	io_done(&io);
 	free(block_enabled);
 
+	/* collapse the info chunks now with all the same info */
+	info_compact(&state->infoarr);
+
 	if (state->opt.expect_recoverable) {
 		if (error + silent_error + io_error == 0)
 			return -1;
@@ -800,12 +800,33 @@ uint64_t tick(void)
 
 uint64_t tick_ms(void)
 {
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+	struct timespec tv;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tv) != 0)
+		return 0;
+
+	return tv.tv_sec * 1000ULL + tv.tv_nsec / 1000000;
+#else
 	struct timeval tv;
 
 	if (gettimeofday(&tv, 0) != 0)
 		return 0;
 
 	return tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+#endif
+}
+
+void sleep_ms(unsigned ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+
+	/* restart if interrupted by a signal */
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		;
 }
 
 int randomize(void* ptr, size_t size)
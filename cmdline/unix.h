@@ -21,6 +21,7 @@
 #ifdef __linux__
 #define HAVE_LINUX_DEVICE 1 /**< In Linux enables special device support. */
 #define HAVE_DIRECT_IO 1 /**< Support O_DIRECT in open(). */
+#define HAVE_DIRECT_IO_DEFAULT 1 /**< Use O_DIRECT by default when reading all the array. */
 #endif
 
 #define O_BINARY 0 /**< Not used in Unix. */
@@ -25,6 +25,71 @@
 /****************************************************************************/
 /* memory */
 
+/**
+ * Size of the huge pages.
+ *
+ * Vectors larger than this are aligned to it, and the kernel is advised
+ * to back them with transparent huge pages, to reduce the TLB misses when
+ * accessing many buffers.
+ */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * Alignment to use for a vector of the specified total size.
+ */
+static size_t huge_align(size_t total_size, size_t align_size)
+{
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+	if (total_size >= HUGE_PAGE_SIZE && align_size < HUGE_PAGE_SIZE)
+		return HUGE_PAGE_SIZE;
+#else
+	(void)total_size;
+#endif
+	return align_size;
+}
+
+/**
+ * Advise the kernel to back a vector with huge pages.
+ *
+ * It must be called before touching the memory, as huge pages are
+ * allocated at the first access. Errors are ignored, as transparent huge
+ * pages may be disabled or not supported.
+ */
+static void huge_advise(int n, size_t size, void** vv)
+{
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+	uintptr_t begin;
+	uintptr_t end;
+	int i;
+
+	if (n == 0)
+		return;
+
+	/* the vector may be reordered, so search the bounds */
+	begin = (uintptr_t)vv[0];
+	end = begin + size;
+	for (i = 1; i < n; ++i) {
+		uintptr_t ptr = (uintptr_t)vv[i];
+		if (begin > ptr)
+			begin = ptr;
+		if (end < ptr + size)
+			end = ptr + size;
+	}
+
+	/* restrict to the full huge pages */
+	begin = (begin + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+	end = end & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+	if (begin >= end)
+		return;
+
+	madvise((void*)begin, end - begin, MADV_HUGEPAGE);
+#else
+	(void)n;
+	(void)size;
+	(void)vv;
+#endif
+}
+
 void* malloc_nofail_align(size_t size, void** freeptr)
 {
 	void* ptr;
@@ -61,7 +126,7 @@ void** malloc_nofail_vector_align(int nd, int n, size_t size, void** freeptr)
 {
 	void* ptr;
 
-	ptr = raid_malloc_vector(nd, n, size, freeptr);
+	ptr = raid_malloc_vector_align(nd, n, size, huge_align(n * size, RAID_MALLOC_ALIGN), RAID_MALLOC_DISPLACEMENT, freeptr);
 
 	if (!ptr) {
 		/* LCOV_EXCL_START */
@@ -70,6 +135,8 @@ void** malloc_nofail_vector_align(int nd, int n, size_t size, void** freeptr)
 		/* LCOV_EXCL_STOP */
 	}
 
+	huge_advise(n, size, ptr);
+
 	return ptr;
 }
 
@@ -77,7 +144,7 @@ void** malloc_nofail_vector_direct(int nd, int n, size_t size, void** freeptr)
 {
 	void* ptr;
 
-	ptr = raid_malloc_vector_align(nd, n, size, direct_size(), 0, freeptr);
+	ptr = raid_malloc_vector_align(nd, n, size, huge_align(n * size, direct_size()), 0, freeptr);
 
 	if (!ptr) {
 		/* LCOV_EXCL_START */
@@ -86,6 +153,8 @@ void** malloc_nofail_vector_direct(int nd, int n, size_t size, void** freeptr)
 		/* LCOV_EXCL_STOP */
 	}
 
+	huge_advise(n, size, ptr);
+
 	return ptr;
 }
 
@@ -594,6 +663,59 @@ void memhash(unsigned kind, const unsigned char* seed, void* digest, const void*
 	}
 }
 
+#if HAVE_AVX2 && defined(CONFIG_X86_64)
+static int hash_avx2;
+#endif
+
+void memhash_init(void)
+{
+#if HAVE_AVX2 && defined(CONFIG_X86_64)
+	if (raid_cpu_has_avx2())
+		hash_avx2 = 1;
+#endif
+}
+
+void memhash_multi(unsigned kind, const unsigned char* seed, void** digest, void** src, size_t* size, unsigned count)
+{
+	unsigned i;
+
+#if HAVE_AVX2 && defined(CONFIG_X86_64)
+	if (kind == HASH_SPOOKY2 && hash_avx2) {
+		const void* lane_src[4];
+		uint8_t* lane_digest[4];
+		size_t lane_size = 0;
+		unsigned n = 0;
+		unsigned j;
+
+		for (i = 0; i < count; ++i) {
+			/* blocks with a different size are hashed one at time */
+			if (n != 0 && size[i] != lane_size) {
+				memhash(kind, seed, digest[i], src[i], size[i]);
+				continue;
+			}
+
+			lane_src[n] = src[i];
+			lane_digest[n] = digest[i];
+			lane_size = size[i];
+			++n;
+
+			if (n == 4) {
+				SpookyHash128x4_avx2(lane_src, lane_size, seed, lane_digest);
+				n = 0;
+			}
+		}
+
+		/* hash the remaining ones */
+		for (j = 0; j < n; ++j)
+			memhash(kind, seed, lane_digest[j], lane_src[j], lane_size);
+		return;
+	}
+#endif
+
+	for (i = 0; i < count; ++i)
+		memhash(kind, seed, digest[i], src[i], size[i]);
+}
+
 const char* hash_config_name(unsigned kind)
 {
 	switch (kind) {
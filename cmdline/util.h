@@ -197,6 +197,19 @@ void crc32c_init(void);
  */
 void memhash(unsigned kind, const unsigned char* seed, void* digest, const void* src, size_t size);
 
+/**
+ * Compute the HASH of multiple memory blocks.
+ * It produces the same digests of calling memhash() for each block, but
+ * blocks of the same size are hashed together four at time, using SIMD
+ * instructions if available.
+ */
+void memhash_multi(unsigned kind, const unsigned char* seed, void** digest, void** src, size_t* size, unsigned count);
+
+/**
+ * Initialize the multi-buffer hash support.
+ */
+void memhash_init(void);
+
 /**
  * Return the hash name.
  */
@@ -251,6 +264,28 @@ static inline int bit_vect_test(bit_vect_t* bit_vect, size_t off)
 	return (bit_vect[off / BIT_VECT_SIZE] & mask) != 0;
 }
 
+/**
+ * Return the first set bit starting from ::off, or ::max if none.
+ * Empty bytes are skipped at once, making it fast for sparse vectors.
+ */
+static inline size_t bit_vect_next(bit_vect_t* bit_vect, size_t off, size_t max)
+{
+	while (off < max) {
+		/* skip a full empty byte at once */
+		if (off % BIT_VECT_SIZE == 0 && bit_vect[off / BIT_VECT_SIZE] == 0) {
+			off += BIT_VECT_SIZE;
+			continue;
+		}
+
+		if (bit_vect_test(bit_vect, off))
+			return off;
+
+		++off;
+	}
+
+	return max;
+}
+
 /****************************************************************************/
 /* muldiv */
 
@@ -47,20 +47,14 @@ static int raid_validate(int nr, int *id, int nv, int *ip, int nd, size_t size,
 {
 	uint8_t **v = (uint8_t **)vv;
 	const uint8_t *T[RAID_PARITY_MAX][RAID_PARITY_MAX];
-	uint8_t G[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	uint8_t V[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	size_t i;
 	int j, k, l;
 
 	BUG_ON(nr >= nv);
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < nr; ++j)
-		for (k = 0; k < nr; ++k)
-			G[j * nr + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, nr);
+	/* invert the coefficients matrix to solve the system of linear equations */
+	raid_invert_coeff(0, nr, id, ip, V);
 
 	/* get multiplication tables */
 	for (j = 0; j < nr; ++j)
@@ -153,6 +153,81 @@ void raid_gen2_int64(int nd, size_t size, void **vv)
 	}
 }
 
+/*
+ * VER1 (RAID5 with xor) 64bit C implementation
+ */
+int raid_ver1_int64(int nd, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t **)vv;
+	uint8_t *p;
+	int d, l;
+	size_t i;
+
+	uint64_t p0;
+	uint64_t p1;
+	uint64_t e0;
+
+	l = nd - 1;
+	p = v[nd + 1];
+
+	e0 = 0;
+	for (i = 0; i < size; i += 16) {
+		p0 = v_64(p[i]);
+		p1 = v_64(p[i + 8]);
+		for (d = l; d >= 0; --d) {
+			p0 ^= v_64(v[d][i]);
+			p1 ^= v_64(v[d][i + 8]);
+		}
+		e0 |= p0 | p1;
+	}
+
+	return e0 != 0;
+}
+
+/*
+ * VER2 (RAID6 with powers of 2) 64bit C implementation
+ */
+int raid_ver2_int64(int nd, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t **)vv;
+	uint8_t *p;
+	uint8_t *q;
+	int d, l;
+	size_t i;
+
+	uint64_t d0, q0, p0;
+	uint64_t d1, q1, p1;
+	uint64_t e0, e1;
+
+	l = nd - 1;
+	p = v[nd + 2];
+	q = v[nd + 3];
+
+	e0 = 0;
+	e1 = 0;
+	for (i = 0; i < size; i += 16) {
+		q0 = p0 = v_64(v[l][i]);
+		q1 = p1 = v_64(v[l][i + 8]);
+		for (d = l - 1; d >= 0; --d) {
+			d0 = v_64(v[d][i]);
+			d1 = v_64(v[d][i + 8]);
+
+			p0 ^= d0;
+			p1 ^= d1;
+
+			q0 = x2_64(q0);
+			q1 = x2_64(q1);
+
+			q0 ^= d0;
+			q1 ^= d1;
+		}
+		e0 |= (p0 ^ v_64(p[i])) | (p1 ^ v_64(p[i + 8]));
+		e1 |= (q0 ^ v_64(q[i])) | (q1 ^ v_64(q[i + 8]));
+	}
+
+	return (e0 != 0) | (e1 != 0) << 1;
+}
+
 /*
  * GEN3 (triple parity with Cauchy matrix) 8bit C implementation
  *
@@ -371,6 +446,45 @@ void raid_gen6_int8(int nd, size_t size, void **vv)
 	}
 }
 
+/*
+ * GENX (any number of parity levels) 8bit C implementation
+ *
+ * Table driven version of the GEN functions, using for each coefficient
+ * the two 16 entries tables of the low and high nibble products, like the
+ * PSHUFB kernels. It doesn't depend on the number of levels, and it's the
+ * base for a generic SIMD kernel.
+ */
+void raid_genX_int8(int nd, int np, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t **)vv;
+	const uint8_t *T[RAID_PARITY_MAX][RAID_DATA_MAX];
+	uint8_t p0[RAID_PARITY_MAX];
+	int d, j;
+	size_t i;
+
+	/* select the multiplication tables of the coefficients */
+	for (j = 0; j < np; ++j)
+		for (d = 0; d < nd; ++d)
+			T[j][d] = gfmulpshufb[gfgen[j][d]][0];
+
+	for (i = 0; i < size; i += 1) {
+		for (j = 0; j < np; ++j)
+			p0[j] = 0;
+
+		for (d = 0; d < nd; ++d) {
+			uint8_t d0 = v_8(v[d][i]);
+			uint8_t lo = d0 & 0x0f;
+			uint8_t hi = d0 >> 4;
+
+			for (j = 0; j < np; ++j)
+				p0[j] ^= T[j][d][lo] ^ T[j][d][16 + hi];
+		}
+
+		for (j = 0; j < np; ++j)
+			v_8(v[nd + j][i]) = p0[j];
+	}
+}
+
 /*
  * Recover failure of one data block at index id[0] using parity at index
  * ip[0] for any RAID level.
@@ -383,7 +497,7 @@ void raid_gen6_int8(int nd, size_t size, void **vv)
  *
  * Dx = A[ip[0],id[0]]^-1 * Pd
  */
-void raid_rec1_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec1_int8(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
 	uint8_t *p;
@@ -393,6 +507,7 @@ void raid_rec1_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 	uint8_t V;
 	size_t i;
 
+	(void)cache; /* unused, it doesn't invert a matrix */
 	(void)nr; /* unused, it's always 1 */
 
 	/* if it's RAID5 uses the faster function */
@@ -436,7 +551,7 @@ void raid_rec1_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
  *
  * we solve inverting the coefficients matrix.
  */
-void raid_rec2_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec2_int8(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
 	uint8_t *p;
@@ -445,7 +560,6 @@ void raid_rec2_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 	uint8_t *qa;
 	const int N = 2;
 	const uint8_t *T[N][N];
-	uint8_t G[N * N];
 	uint8_t V[N * N];
 	size_t i;
 	int j, k;
@@ -458,13 +572,8 @@ void raid_rec2_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 		return;
 	}
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
+	/* invert the coefficients matrix to solve the system of linear equations */
+	raid_invert_coeff(cache, N, id, ip, V);
 
 	/* get multiplication tables */
 	for (j = 0; j < N; ++j)
@@ -504,24 +613,18 @@ void raid_rec2_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
  * PD[0] = Pd, PD[1] = Qd, PD[2] = Rd, ...
  * D[0] = Dx, D[1] = Dy, D[2] = Dz, ...
  */
-void raid_recX_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_recX_int8(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
 	uint8_t *p[RAID_PARITY_MAX];
 	uint8_t *pa[RAID_PARITY_MAX];
 	const uint8_t *T[RAID_PARITY_MAX][RAID_PARITY_MAX];
-	uint8_t G[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	uint8_t V[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	size_t i;
 	int j, k;
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < nr; ++j)
-		for (k = 0; k < nr; ++k)
-			G[j * nr + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, nr);
+	/* invert the coefficients matrix to solve the system of linear equations */
+	raid_invert_coeff(cache, nr, id, ip, V);
 
 	/* get multiplication tables */
 	for (j = 0; j < nr; ++j)
@@ -128,6 +128,7 @@ static __always_inline void *__align_ptr(void *ptr, uintptr_t size)
 int raid_selftest(void);
 void raid_gen_ref(int nd, int np, size_t size, void **vv);
 void raid_invert(uint8_t *M, uint8_t *V, int n);
+void raid_invert_coeff(struct raid_cache *cache, int nr, int *id, int *ip, uint8_t *V);
 void raid_delta_gen(int nr, int *id, int *ip, int nd, size_t size, void **v);
 void raid_rec1of1(int *id, int nd, size_t size, void **v);
 void raid_rec2of2_int8(int *id, int *ip, int nd, size_t size, void **vv);
@@ -161,15 +162,22 @@ void raid_gen6_int8(int nd, size_t size, void **vv);
 void raid_gen6_ssse3(int nd, size_t size, void **vv);
 void raid_gen6_ssse3ext(int nd, size_t size, void **vv);
 void raid_gen6_avx2ext(int nd, size_t size, void **vv);
-void raid_rec1_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec2_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_recX_int8(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec1_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec2_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_recX_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec1_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_rec2_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv);
-void raid_recX_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_genX_int8(int nd, int np, size_t size, void **vv);
+int raid_ver1_int64(int nd, size_t size, void **vv);
+int raid_ver1_sse2(int nd, size_t size, void **vv);
+int raid_ver1_avx2(int nd, size_t size, void **vv);
+int raid_ver2_int64(int nd, size_t size, void **vv);
+int raid_ver2_sse2(int nd, size_t size, void **vv);
+int raid_ver2_avx2(int nd, size_t size, void **vv);
+void raid_rec1_int8(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_rec2_int8(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_recX_int8(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_rec1_ssse3(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_rec2_ssse3(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_recX_ssse3(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_rec1_avx2(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_rec2_avx2(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
+void raid_recX_avx2(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
 
 /*
  * Internal naming.
@@ -187,6 +195,11 @@ const char *raid_rec1_tag(void);
 const char *raid_rec2_tag(void);
 const char *raid_recX_tag(void);
 
+/*
+ * Max number of parities with a specialized verify function.
+ */
+#define RAID_VER_MAX 2
+
 /*
  * Internal forwarders.
  */
@@ -194,8 +207,10 @@ extern void (*raid_gen3_ptr)(int nd, size_t size, void **vv);
 extern void (*raid_genz_ptr)(int nd, size_t size, void **vv);
 extern void (*raid_gen_ptr[RAID_PARITY_MAX])(
 	int nd, size_t size, void **vv);
+extern int (*raid_ver_ptr[RAID_VER_MAX])(
+	int nd, size_t size, void **vv);
 extern void (*raid_rec_ptr[RAID_PARITY_MAX])(
-	int nr, int *id, int *ip, int nd, size_t size, void **vv);
+	struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
 
 /*
  * Tables.
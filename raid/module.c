@@ -36,6 +36,9 @@ void raid_init(void)
 		raid_genz_ptr = raid_genz_int64;
 	}
 
+	raid_ver_ptr[0] = raid_ver1_int64;
+	raid_ver_ptr[1] = raid_ver2_int64;
+
 	raid_rec_ptr[0] = raid_rec1_int8;
 	raid_rec_ptr[1] = raid_rec2_int8;
 	raid_rec_ptr[2] = raid_recX_int8;
@@ -47,6 +50,8 @@ void raid_init(void)
 #ifdef CONFIG_SSE2
 	if (raid_cpu_has_sse2()) {
 		raid_gen_ptr[0] = raid_gen1_sse2;
+		raid_ver_ptr[0] = raid_ver1_sse2;
+		raid_ver_ptr[1] = raid_ver2_sse2;
 #ifdef CONFIG_X86_64
 		if (raid_cpu_has_slowextendedreg()) {
 			raid_gen_ptr[1] = raid_gen2_sse2;
@@ -95,6 +100,8 @@ void raid_init(void)
 	if (raid_cpu_has_avx2()) {
 		raid_gen_ptr[0] = raid_gen1_avx2;
 		raid_gen_ptr[1] = raid_gen2_avx2;
+		raid_ver_ptr[0] = raid_ver1_avx2;
+		raid_ver_ptr[1] = raid_ver2_avx2;
 #ifdef CONFIG_X86_64
 		raid_gen3_ptr = raid_gen3_avx2ext;
 		raid_genz_ptr = raid_genz_avx2ext;
@@ -232,6 +232,41 @@ void raid_gen(int nd, int np, size_t size, void **v)
 	raid_gen_ptr[np - 1](nd, size, v);
 }
 
+/**
+ * Specialized functions for verifying parity.
+ *
+ * They are used only for the first parity levels, because with more levels
+ * computing the parity is slower than writing and reading it back.
+ */
+int (*raid_ver_ptr[RAID_VER_MAX])(int nd, size_t size, void **vv);
+
+int raid_gen_verify(int nd, int np, size_t size, void **v)
+{
+	int mask;
+	int i;
+
+	/* enforce limit on size */
+	BUG_ON(size % 64 != 0);
+
+	/* enforce limit on number of failures */
+	BUG_ON(np < 1);
+	BUG_ON(np > RAID_PARITY_MAX);
+
+	/* use the specialized function, if any */
+	if (np <= RAID_VER_MAX)
+		return raid_ver_ptr[np - 1](nd, size, v);
+
+	/* otherwise compute the parity and compare it */
+	raid_gen_ptr[np - 1](nd, size, v);
+
+	mask = 0;
+	for (i = 0; i < np; ++i)
+		if (memcmp(v[nd + i], v[nd + np + i], size) != 0)
+			mask |= 1 << i;
+
+	return mask;
+}
+
 /**
  * Inverts the square matrix M of size nxn into V.
  *
@@ -282,6 +317,87 @@ void raid_invert(uint8_t *M, uint8_t *V, int n)
 	}
 }
 
+void raid_cache_init(struct raid_cache *cache)
+{
+	memset(cache, 0, sizeof(struct raid_cache));
+}
+
+/**
+ * Computes the inverse of the coefficients matrix used to recover
+ * the data blocks @id[] using the parity blocks @ip[].
+ *
+ * The same matrices are requested again and again when recovering
+ * many blocks with the same failures, so the latest ones are cached.
+ *
+ * @cache Cache of inverted matrices. 0 to always compute the matrix.
+ * @nr Number of failures.
+ * @id[] Vector of @nr indexes of the data blocks to recover.
+ * @ip[] Vector of @nr indexes of the parity blocks to use in the recovering.
+ * @V Destination matrix where the result is put.
+ */
+void raid_invert_coeff(struct raid_cache *cache, int nr, int *id, int *ip, uint8_t *V)
+{
+	struct raid_cache_entry *e;
+	uint8_t G[RAID_PARITY_MAX * RAID_PARITY_MAX];
+	int i, j, k;
+
+	/* the indexes are stored in bytes */
+	BUG_ON(nr > RAID_PARITY_MAX);
+	BUG_ON(nr > 0 && id[nr - 1] >= RAID_DATA_MAX);
+
+	e = 0;
+	if (cache) {
+		/* on wrap around, restart all the entries from the same time */
+		if (++cache->stamp == 0) {
+			for (i = 0; i < RAID_CACHE_MAX; ++i)
+				cache->entry[i].stamp = 0;
+			cache->stamp = 1;
+		}
+
+		/* search in the cache */
+		e = &cache->entry[0];
+		for (i = 0; i < RAID_CACHE_MAX; ++i) {
+			struct raid_cache_entry *c = &cache->entry[i];
+
+			if (c->gen == raid_gfgen && c->nr == nr) {
+				for (j = 0; j < nr; ++j)
+					if (c->id[j] != id[j] || c->ip[j] != ip[j])
+						break;
+				if (j == nr) {
+					c->stamp = cache->stamp;
+					memcpy(V, c->V, nr * nr);
+					return;
+				}
+			}
+
+			/* keep track of the least recently used entry */
+			if (c->stamp < e->stamp)
+				e = c;
+		}
+	}
+
+	/* setup the coefficients matrix */
+	for (j = 0; j < nr; ++j)
+		for (k = 0; k < nr; ++k)
+			G[j * nr + k] = A(ip[j], id[k]);
+
+	/* invert it to solve the system of linear equations */
+	raid_invert(G, V, nr);
+
+	if (!e)
+		return;
+
+	/* replace the least recently used entry */
+	e->gen = raid_gfgen;
+	e->nr = nr;
+	for (j = 0; j < nr; ++j) {
+		e->id[j] = id[j];
+		e->ip[j] = ip[j];
+	}
+	memcpy(e->V, V, nr * nr);
+	e->stamp = cache->stamp;
+}
+
 /**
  * Computes the parity without the missing data blocks
  * and store it in the buffers of such data blocks.
@@ -476,6 +592,7 @@ void raid_rec2of2_int8(int *id, int *ip, int nd, size_t size, void **vv)
  * For example, in the vector @ip the first parity is represented with the
  * value 0 and not @nd.
  *
+ * @cache Cache of inverted matrices. 0 to not use it.
  * @nr Number of failed data blocks to recover.
  * @id[] Vector of @nr indexes of the data blocks to recover.
  *   The indexes start from 0. They must be in order.
@@ -490,9 +607,14 @@ void raid_rec2of2_int8(int *id, int *ip, int nd, size_t size, void **vv)
  *   Each block has @size bytes.
  */
 void (*raid_rec_ptr[RAID_PARITY_MAX])(
-	int nr, int *id, int *ip, int nd, size_t size, void **vv);
+	struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv);
 
 void raid_rec(int nr, int *ir, int nd, int np, size_t size, void **v)
+{
+	raid_rec_cache(0, nr, ir, nd, np, size, v);
+}
+
+void raid_rec_cache(struct raid_cache *cache, int nr, int *ir, int nd, int np, size_t size, void **v)
 {
 	int nrd; /* number of data blocks to recover */
 	int nrp; /* number of parity blocks to recover */
@@ -545,7 +667,7 @@ void raid_rec(int nr, int *ir, int nd, int np, size_t size, void **v)
 
 		/* recover the nrd data blocks specified in ir[], */
 		/* using the first nrd parity in ip[] for recovering */
-		raid_rec_ptr[nrd - 1](nrd, ir, ip, nd, size, v);
+		raid_rec_ptr[nrd - 1](cache, nrd, ir, ip, nd, size, v);
 	}
 
 	/* recompute all the parities up to the last bad one */
@@ -554,6 +676,11 @@ void raid_rec(int nr, int *ir, int nd, int np, size_t size, void **v)
 }
 
 void raid_data(int nr, int *id, int *ip, int nd, size_t size, void **v)
+{
+	raid_data_cache(0, nr, id, ip, nd, size, v);
+}
+
+void raid_data_cache(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **v)
 {
 	/* enforce limit on size */
 	BUG_ON(size % 64 != 0);
@@ -581,6 +708,6 @@ void raid_data(int nr, int *id, int *ip, int nd, size_t size, void **v)
 
 	/* if failed data is present */
 	if (nr != 0)
-		raid_rec_ptr[nr - 1](nr, id, ip, nd, size, v);
+		raid_rec_ptr[nr - 1](cache, nr, id, ip, nd, size, v);
 }
 
@@ -103,6 +103,30 @@ void raid_zero(void *zero);
  */
 void raid_gen(int nd, int np, size_t size, void **v);
 
+/**
+ * Verifies parity blocks.
+ *
+ * This function computes the specified number of parity blocks of the
+ * provided set of data blocks, and compares them with the expected ones.
+ *
+ * For the first two parity levels, the parity is compared while computed,
+ * without writing it, halving the memory traffic compared at calling
+ * raid_gen() and memcmp().
+ *
+ * @nd Number of data blocks.
+ * @np Number of parities blocks to verify.
+ * @size Size of the blocks pointed by @v. It must be a multiplier of 64.
+ * @v Vector of pointers to the blocks of data and parity.
+ *   It has (@nd + @np + @np) elements. The starting elements are the blocks
+ *   for data, following with the parity blocks where the parity may be
+ *   computed, and with the parity blocks with the expected parity.
+ *   Data blocks and expected parity blocks are only read and not modified.
+ *   The content of the computed parity blocks is undefined.
+ *   Each block has @size bytes.
+ * @return Bit mask of the parity blocks not matching. 0 if all are matching.
+ */
+int raid_gen_verify(int nd, int np, size_t size, void **v);
+
 /**
  * Recovers failures in data and parity blocks.
  *
@@ -158,6 +182,49 @@ void raid_rec(int nr, int *ir, int nd, int np, size_t size, void **v);
  */
 void raid_data(int nr, int *id, int *ip, int nd, size_t size, void **v);
 
+/**
+ * Number of entries in the cache of inverted matrices.
+ */
+#define RAID_CACHE_MAX 8
+
+/**
+ * Cache of the inverted matrices used in recovering.
+ *
+ * When recovering many blocks with the same failures, the same matrix is
+ * inverted again and again. The cache keeps the latest ones.
+ *
+ * The cache is owned by the caller, and it must not be used by more than
+ * one thread at the same time. Initialize it with raid_cache_init().
+ */
+struct raid_cache {
+	struct raid_cache_entry {
+		const void *gen; /**< Generator matrix used. 0 if the entry is empty. */
+		int nr; /**< Number of failures. */
+		unsigned char id[RAID_PARITY_MAX]; /**< Indexes of the data blocks. */
+		unsigned char ip[RAID_PARITY_MAX]; /**< Indexes of the parity blocks. */
+		unsigned char V[RAID_PARITY_MAX * RAID_PARITY_MAX]; /**< Inverted matrix. */
+		unsigned stamp; /**< Last use, for the LRU replacement. */
+	} entry[RAID_CACHE_MAX];
+	unsigned stamp; /**< Current time for the LRU replacement. */
+};
+
+/**
+ * Initializes an empty cache of inverted matrices.
+ */
+void raid_cache_init(struct raid_cache *cache);
+
+/**
+ * Recovers failures in data and parity blocks, like raid_rec(),
+ * using the specified cache of inverted matrices.
+ */
+void raid_rec_cache(struct raid_cache *cache, int nr, int *ir, int nd, int np, size_t size, void **v);
+
+/**
+ * Recovers failures in data blocks only, like raid_data(),
+ * using the specified cache of inverted matrices.
+ */
+void raid_data_cache(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **v);
+
 /**
  * Check the provided failed blocks combination.
  *
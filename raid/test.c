@@ -146,7 +146,8 @@ int raid_test_sort(void)
 int raid_test_rec(int mode, int nd, size_t size)
 {
 	void (*f[RAID_PARITY_MAX][4])(
-		int nr, int *id, int *ip, int nd, size_t size, void **vbuf);
+		struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vbuf);
+	struct raid_cache cache;
 	void *v_alloc;
 	void **v;
 	void **data;
@@ -236,6 +237,10 @@ int raid_test_rec(int mode, int nd, size_t size)
 		}
 	}
 
+	/* start the cache near the wrap around of its time, to test it */
+	raid_cache_init(&cache);
+	cache.stamp = -64;
+
 	/* compute the parity */
 	raid_gen_ref(nd, np, size, v);
 
@@ -263,7 +268,7 @@ int raid_test_rec(int mode, int nd, size_t size)
 					}
 
 					/* recover */
-					f[nr - 1][j](nr, id, ip, nd, size, v);
+					f[nr - 1][j](&cache, nr, id, ip, nd, size, v);
 
 					/* check */
 					for (i = 0; i < nr; ++i) {
@@ -301,10 +306,13 @@ bail:
 int raid_test_par(int mode, int nd, size_t size)
 {
 	void (*f[64])(int nd, size_t size, void **vbuf);
+	int (*g[64])(int nd, size_t size, void **vbuf);
+	int gp[64];
+	void *w[RAID_DATA_MAX + RAID_PARITY_MAX * 2];
 	void *v_alloc;
 	void **v;
 	int nv;
-	int i, j;
+	int i, j, l;
 	int nf;
 	int np;
 
@@ -438,6 +446,97 @@ int raid_test_par(int mode, int nd, size_t size)
 		}
 	}
 
+	/* check the generic function for all the levels */
+	for (l = 1; l <= np; ++l) {
+		raid_genX_int8(nd, l, size, v);
+
+		for (i = 0; i < l; ++i) {
+			if (memcmp(v[nd + np + i], v[nd + i], size) != 0) {
+				/* LCOV_EXCL_START */
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+		}
+	}
+
+	/* load all the available verify functions */
+	nf = 0;
+
+	g[nf] = raid_ver1_int64;
+	gp[nf++] = 1;
+	g[nf] = raid_ver2_int64;
+	gp[nf++] = 2;
+
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSE2
+	if (raid_cpu_has_sse2()) {
+		g[nf] = raid_ver1_sse2;
+		gp[nf++] = 1;
+		g[nf] = raid_ver2_sse2;
+		gp[nf++] = 2;
+	}
+#endif
+
+#ifdef CONFIG_AVX2
+	if (raid_cpu_has_avx2()) {
+		g[nf] = raid_ver1_avx2;
+		gp[nf++] = 1;
+		g[nf] = raid_ver2_avx2;
+		gp[nf++] = 2;
+	}
+#endif
+#endif /* CONFIG_X86 */
+
+	/* check all the verify functions, the expected parity is in the back buffers */
+	for (j = 0; j < nf; ++j) {
+		int k = gp[j];
+
+		if (k > np)
+			continue;
+
+		for (i = 0; i < nd + k; ++i)
+			w[i] = v[i];
+		for (i = 0; i < k; ++i)
+			w[nd + k + i] = v[nd + np + i];
+
+		if (g[j](nd, size, w) != 0) {
+			/* LCOV_EXCL_START */
+			goto bail;
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* with a wrong byte at the end of each parity */
+		for (i = 0; i < k; ++i) {
+			uint8_t *p = v[nd + np + i];
+
+			p[size - 1] ^= 1;
+			if (g[j](nd, size, w) != 1 << i) {
+				/* LCOV_EXCL_START */
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+			p[size - 1] ^= 1;
+		}
+	}
+
+	/* check the generic verify function */
+	if (raid_gen_verify(nd, np, size, v) != 0) {
+		/* LCOV_EXCL_START */
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+	for (i = 0; i < np; ++i) {
+		uint8_t *p = v[nd + np + i];
+
+		p[0] ^= 1;
+		if (raid_gen_verify(nd, np, size, v) != 1 << i) {
+			/* LCOV_EXCL_START */
+			goto bail;
+			/* LCOV_EXCL_STOP */
+		}
+		p[0] ^= 1;
+	}
+
 	free(v_alloc);
 	free(v);
 	return 0;
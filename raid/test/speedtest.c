@@ -604,7 +604,7 @@ void speed(void)
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
 			/* +1 to avoid GEN1 optimized case */
-			raid_rec1_int8(1, id, ip + 1, nd, size, v);
+			raid_rec1_int8(0, 1, id, ip + 1, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -616,7 +616,7 @@ void speed(void)
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
 				/* +1 to avoid GEN1 optimized case */
-				raid_rec1_ssse3(1, id, ip + 1, nd, size, v);
+				raid_rec1_ssse3(0, 1, id, ip + 1, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -627,7 +627,7 @@ void speed(void)
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
 				/* +1 to avoid GEN1 optimized case */
-				raid_rec1_avx2(1, id, ip + 1, nd, size, v);
+				raid_rec1_avx2(0, 1, id, ip + 1, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -643,7 +643,7 @@ void speed(void)
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
 			/* +1 to avoid GEN2 optimized case */
-			raid_rec2_int8(2, id, ip + 1, nd, size, v);
+			raid_rec2_int8(0, 2, id, ip + 1, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -655,7 +655,7 @@ void speed(void)
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
 				/* +1 to avoid GEN2 optimized case */
-				raid_rec2_ssse3(2, id, ip + 1, nd, size, v);
+				raid_rec2_ssse3(0, 2, id, ip + 1, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -666,7 +666,7 @@ void speed(void)
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
 				/* +1 to avoid GEN1 optimized case */
-				raid_rec2_avx2(2, id, ip + 1, nd, size, v);
+				raid_rec2_avx2(0, 2, id, ip + 1, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -681,7 +681,7 @@ void speed(void)
 
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(3, id, ip, nd, size, v);
+			raid_recX_int8(0, 3, id, ip, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -692,7 +692,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(3, id, ip, nd, size, v);
+				raid_recX_ssse3(0, 3, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -702,7 +702,7 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(3, id, ip, nd, size, v);
+				raid_recX_avx2(0, 3, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -717,7 +717,7 @@ void speed(void)
 
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(4, id, ip, nd, size, v);
+			raid_recX_int8(0, 4, id, ip, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -728,7 +728,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(4, id, ip, nd, size, v);
+				raid_recX_ssse3(0, 4, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -738,7 +738,7 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(4, id, ip, nd, size, v);
+				raid_recX_avx2(0, 4, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -753,7 +753,7 @@ void speed(void)
 
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(5, id, ip, nd, size, v);
+			raid_recX_int8(0, 5, id, ip, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -764,7 +764,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(5, id, ip, nd, size, v);
+				raid_recX_ssse3(0, 5, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -774,7 +774,7 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(5, id, ip, nd, size, v);
+				raid_recX_avx2(0, 5, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -789,7 +789,7 @@ void speed(void)
 
 	SPEED_START {
 		for (j = 0; j < nd; ++j)
-			raid_recX_int8(6, id, ip, nd, size, v);
+			raid_recX_int8(0, 6, id, ip, nd, size, v);
 	} SPEED_STOP
 
 	printf("%8" PRIu64, ds / dt);
@@ -800,7 +800,7 @@ void speed(void)
 	if (raid_cpu_has_ssse3()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_ssse3(6, id, ip, nd, size, v);
+				raid_recX_ssse3(0, 6, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -810,7 +810,7 @@ void speed(void)
 	if (raid_cpu_has_avx2()) {
 		SPEED_START {
 			for (j = 0; j < nd; ++j)
-				raid_recX_avx2(6, id, ip, nd, size, v);
+				raid_recX_avx2(0, 6, id, ip, nd, size, v);
 		} SPEED_STOP
 
 		printf("%8" PRIu64, ds / dt);
@@ -15,6 +15,15 @@
 #include "internal.h"
 #include "gf.h"
 
+/*
+ * Distance in bytes of the software prefetch of the data disks.
+ *
+ * With many data disks there are more input streams than the hardware
+ * prefetcher is able to track, and without this the memory bound kernels
+ * stall on every new cache line.
+ */
+#define RAID_PREFETCH 1024
+
 /*
  * For x86 optimizations you can see:
  *
@@ -46,11 +55,13 @@ void raid_gen1_sse2(int nd, size_t size, void **vv)
 	raid_sse_begin();
 
 	for (i = 0; i < size; i += 64) {
+		asm volatile ("prefetcht0 %0" : : "m" (v[l][i + RAID_PREFETCH]));
 		asm volatile ("movdqa %0,%%xmm0" : : "m" (v[l][i]));
 		asm volatile ("movdqa %0,%%xmm1" : : "m" (v[l][i + 16]));
 		asm volatile ("movdqa %0,%%xmm2" : : "m" (v[l][i + 32]));
 		asm volatile ("movdqa %0,%%xmm3" : : "m" (v[l][i + 48]));
 		for (d = l - 1; d >= 0; --d) {
+			asm volatile ("prefetcht0 %0" : : "m" (v[d][i + RAID_PREFETCH]));
 			asm volatile ("pxor %0,%%xmm0" : : "m" (v[d][i]));
 			asm volatile ("pxor %0,%%xmm1" : : "m" (v[d][i + 16]));
 			asm volatile ("pxor %0,%%xmm2" : : "m" (v[d][i + 32]));
@@ -87,9 +98,11 @@ void raid_gen1_avx2(int nd, size_t size, void **vv)
 	raid_avx_begin();
 
 	for (i = 0; i < size; i += 64) {
+		asm volatile ("prefetcht0 %0" : : "m" (v[l][i + RAID_PREFETCH]));
 		asm volatile ("vmovdqa %0,%%ymm0" : : "m" (v[l][i]));
 		asm volatile ("vmovdqa %0,%%ymm1" : : "m" (v[l][i + 32]));
 		for (d = l - 1; d >= 0; --d) {
+			asm volatile ("prefetcht0 %0" : : "m" (v[d][i + RAID_PREFETCH]));
 			asm volatile ("vpxor %0,%%ymm0,%%ymm0" : : "m" (v[d][i]));
 			asm volatile ("vpxor %0,%%ymm1,%%ymm1" : : "m" (v[d][i + 32]));
 		}
@@ -138,6 +151,7 @@ void raid_gen2_sse2(int nd, size_t size, void **vv)
 	asm volatile ("movdqa %0,%%xmm7" : : "m" (gfconst16.poly[0]));
 
 	for (i = 0; i < size; i += 32) {
+		asm volatile ("prefetcht0 %0" : : "m" (v[l][i + RAID_PREFETCH]));
 		asm volatile ("movdqa %0,%%xmm0" : : "m" (v[l][i]));
 		asm volatile ("movdqa %0,%%xmm1" : : "m" (v[l][i + 16]));
 		asm volatile ("movdqa %xmm0,%xmm2");
@@ -154,6 +168,7 @@ void raid_gen2_sse2(int nd, size_t size, void **vv)
 			asm volatile ("pxor %xmm4,%xmm2");
 			asm volatile ("pxor %xmm5,%xmm3");
 
+			asm volatile ("prefetcht0 %0" : : "m" (v[d][i + RAID_PREFETCH]));
 			asm volatile ("movdqa %0,%%xmm4" : : "m" (v[d][i]));
 			asm volatile ("movdqa %0,%%xmm5" : : "m" (v[d][i + 16]));
 			asm volatile ("pxor %xmm4,%xmm0");
@@ -193,6 +208,7 @@ void raid_gen2_avx2(int nd, size_t size, void **vv)
 	asm volatile ("vpxor %ymm6,%ymm6,%ymm6");
 
 	for (i = 0; i < size; i += 64) {
+		asm volatile ("prefetcht0 %0" : : "m" (v[l][i + RAID_PREFETCH]));
 		asm volatile ("vmovdqa %0,%%ymm0" : : "m" (v[l][i]));
 		asm volatile ("vmovdqa %0,%%ymm1" : : "m" (v[l][i + 32]));
 		asm volatile ("vmovdqa %ymm0,%ymm2");
@@ -207,6 +223,7 @@ void raid_gen2_avx2(int nd, size_t size, void **vv)
 			asm volatile ("vpxor %ymm4,%ymm2,%ymm2");
 			asm volatile ("vpxor %ymm5,%ymm3,%ymm3");
 
+			asm volatile ("prefetcht0 %0" : : "m" (v[d][i + RAID_PREFETCH]));
 			asm volatile ("vmovdqa %0,%%ymm4" : : "m" (v[d][i]));
 			asm volatile ("vmovdqa %0,%%ymm5" : : "m" (v[d][i + 32]));
 			asm volatile ("vpxor %ymm4,%ymm0,%ymm0");
@@ -224,6 +241,238 @@ void raid_gen2_avx2(int nd, size_t size, void **vv)
 }
 #endif
 
+#if defined(CONFIG_X86) && defined(CONFIG_SSE2)
+/*
+ * VER1 (RAID5 with xor) SSE2 implementation
+ *
+ * The differences with the expected parity are accumulated in xmm7.
+ */
+int raid_ver1_sse2(int nd, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t **)vv;
+	uint8_t *p;
+	int d, l;
+	size_t i;
+	uint32_t m;
+
+	l = nd - 1;
+	p = v[nd + 1];
+
+	raid_sse_begin();
+
+	asm volatile ("pxor %xmm7,%xmm7");
+
+	for (i = 0; i < size; i += 64) {
+		asm volatile ("movdqa %0,%%xmm0" : : "m" (p[i]));
+		asm volatile ("movdqa %0,%%xmm1" : : "m" (p[i + 16]));
+		asm volatile ("movdqa %0,%%xmm2" : : "m" (p[i + 32]));
+		asm volatile ("movdqa %0,%%xmm3" : : "m" (p[i + 48]));
+		for (d = l; d >= 0; --d) {
+			asm volatile ("prefetcht0 %0" : : "m" (v[d][i + RAID_PREFETCH]));
+			asm volatile ("pxor %0,%%xmm0" : : "m" (v[d][i]));
+			asm volatile ("pxor %0,%%xmm1" : : "m" (v[d][i + 16]));
+			asm volatile ("pxor %0,%%xmm2" : : "m" (v[d][i + 32]));
+			asm volatile ("pxor %0,%%xmm3" : : "m" (v[d][i + 48]));
+		}
+		asm volatile ("por %xmm0,%xmm7");
+		asm volatile ("por %xmm1,%xmm7");
+		asm volatile ("por %xmm2,%xmm7");
+		asm volatile ("por %xmm3,%xmm7");
+	}
+
+	asm volatile ("pxor %xmm6,%xmm6");
+	asm volatile ("pcmpeqb %xmm6,%xmm7");
+	asm volatile ("pmovmskb %%xmm7,%0" : "=r" (m));
+
+	raid_sse_end();
+
+	return m != 0xffff;
+}
+#endif
+
+#if defined(CONFIG_X86) && defined(CONFIG_AVX2)
+/*
+ * VER1 (RAID5 with xor) AVX2 implementation
+ *
+ * The differences with the expected parity are accumulated in ymm7.
+ */
+int raid_ver1_avx2(int nd, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t **)vv;
+	uint8_t *p;
+	int d, l;
+	size_t i;
+	uint8_t e;
+
+	l = nd - 1;
+	p = v[nd + 1];
+
+	raid_avx_begin();
+
+	asm volatile ("vpxor %ymm7,%ymm7,%ymm7");
+
+	for (i = 0; i < size; i += 64) {
+		asm volatile ("vmovdqa %0,%%ymm0" : : "m" (p[i]));
+		asm volatile ("vmovdqa %0,%%ymm1" : : "m" (p[i + 32]));
+		for (d = l; d >= 0; --d) {
+			asm volatile ("prefetcht0 %0" : : "m" (v[d][i + RAID_PREFETCH]));
+			asm volatile ("vpxor %0,%%ymm0,%%ymm0" : : "m" (v[d][i]));
+			asm volatile ("vpxor %0,%%ymm1,%%ymm1" : : "m" (v[d][i + 32]));
+		}
+		asm volatile ("vpor %ymm0,%ymm7,%ymm7");
+		asm volatile ("vpor %ymm1,%ymm7,%ymm7");
+	}
+
+	asm volatile ("vptest %%ymm7,%%ymm7\n\tsetnz %0" : "=qm" (e));
+
+	raid_avx_end();
+
+	return e;
+}
+#endif
+
+#if defined(CONFIG_X86) && defined(CONFIG_SSE2)
+/*
+ * VER2 (RAID6 with powers of 2) SSE2 implementation
+ *
+ * There are no free registers, so the differences are checked at each step.
+ */
+int raid_ver2_sse2(int nd, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t **)vv;
+	uint8_t *p;
+	uint8_t *q;
+	int d, l;
+	size_t i;
+	uint32_t mp, mq;
+	uint32_t ep, eq;
+
+	l = nd - 1;
+	p = v[nd + 2];
+	q = v[nd + 3];
+
+	raid_sse_begin();
+
+	asm volatile ("movdqa %0,%%xmm7" : : "m" (gfconst16.poly[0]));
+
+	ep = 0;
+	eq = 0;
+	for (i = 0; i < size; i += 32) {
+		asm volatile ("prefetcht0 %0" : : "m" (v[l][i + RAID_PREFETCH]));
+		asm volatile ("movdqa %0,%%xmm0" : : "m" (v[l][i]));
+		asm volatile ("movdqa %0,%%xmm1" : : "m" (v[l][i + 16]));
+		asm volatile ("movdqa %xmm0,%xmm2");
+		asm volatile ("movdqa %xmm1,%xmm3");
+		for (d = l - 1; d >= 0; --d) {
+			asm volatile ("pxor %xmm4,%xmm4");
+			asm volatile ("pxor %xmm5,%xmm5");
+			asm volatile ("pcmpgtb %xmm2,%xmm4");
+			asm volatile ("pcmpgtb %xmm3,%xmm5");
+			asm volatile ("paddb %xmm2,%xmm2");
+			asm volatile ("paddb %xmm3,%xmm3");
+			asm volatile ("pand %xmm7,%xmm4");
+			asm volatile ("pand %xmm7,%xmm5");
+			asm volatile ("pxor %xmm4,%xmm2");
+			asm volatile ("pxor %xmm5,%xmm3");
+
+			asm volatile ("prefetcht0 %0" : : "m" (v[d][i + RAID_PREFETCH]));
+			asm volatile ("movdqa %0,%%xmm4" : : "m" (v[d][i]));
+			asm volatile ("movdqa %0,%%xmm5" : : "m" (v[d][i + 16]));
+			asm volatile ("pxor %xmm4,%xmm0");
+			asm volatile ("pxor %xmm5,%xmm1");
+			asm volatile ("pxor %xmm4,%xmm2");
+			asm volatile ("pxor %xmm5,%xmm3");
+		}
+		asm volatile ("pxor %0,%%xmm0" : : "m" (p[i]));
+		asm volatile ("pxor %0,%%xmm1" : : "m" (p[i + 16]));
+		asm volatile ("pxor %0,%%xmm2" : : "m" (q[i]));
+		asm volatile ("pxor %0,%%xmm3" : : "m" (q[i + 16]));
+		asm volatile ("por %xmm1,%xmm0");
+		asm volatile ("por %xmm3,%xmm2");
+		asm volatile ("pxor %xmm4,%xmm4");
+		asm volatile ("pcmpeqb %xmm4,%xmm0");
+		asm volatile ("pcmpeqb %xmm4,%xmm2");
+		asm volatile ("pmovmskb %%xmm0,%0" : "=r" (mp));
+		asm volatile ("pmovmskb %%xmm2,%0" : "=r" (mq));
+		ep |= mp ^ 0xffff;
+		eq |= mq ^ 0xffff;
+	}
+
+	raid_sse_end();
+
+	return (ep != 0) | (eq != 0) << 1;
+}
+#endif
+
+#if defined(CONFIG_X86) && defined(CONFIG_AVX2)
+/*
+ * VER2 (RAID6 with powers of 2) AVX2 implementation
+ *
+ * There are no free registers, so the differences are checked at each step.
+ */
+int raid_ver2_avx2(int nd, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t **)vv;
+	uint8_t *p;
+	uint8_t *q;
+	int d, l;
+	size_t i;
+	uint8_t mp, mq;
+	uint8_t ep, eq;
+
+	l = nd - 1;
+	p = v[nd + 2];
+	q = v[nd + 3];
+
+	raid_avx_begin();
+
+	asm volatile ("vbroadcasti128 %0, %%ymm7" : : "m" (gfconst16.poly[0]));
+	asm volatile ("vpxor %ymm6,%ymm6,%ymm6");
+
+	ep = 0;
+	eq = 0;
+	for (i = 0; i < size; i += 64) {
+		asm volatile ("prefetcht0 %0" : : "m" (v[l][i + RAID_PREFETCH]));
+		asm volatile ("vmovdqa %0,%%ymm0" : : "m" (v[l][i]));
+		asm volatile ("vmovdqa %0,%%ymm1" : : "m" (v[l][i + 32]));
+		asm volatile ("vmovdqa %ymm0,%ymm2");
+		asm volatile ("vmovdqa %ymm1,%ymm3");
+		for (d = l - 1; d >= 0; --d) {
+			asm volatile ("vpcmpgtb %ymm2,%ymm6,%ymm4");
+			asm volatile ("vpcmpgtb %ymm3,%ymm6,%ymm5");
+			asm volatile ("vpaddb %ymm2,%ymm2,%ymm2");
+			asm volatile ("vpaddb %ymm3,%ymm3,%ymm3");
+			asm volatile ("vpand %ymm7,%ymm4,%ymm4");
+			asm volatile ("vpand %ymm7,%ymm5,%ymm5");
+			asm volatile ("vpxor %ymm4,%ymm2,%ymm2");
+			asm volatile ("vpxor %ymm5,%ymm3,%ymm3");
+
+			asm volatile ("prefetcht0 %0" : : "m" (v[d][i + RAID_PREFETCH]));
+			asm volatile ("vmovdqa %0,%%ymm4" : : "m" (v[d][i]));
+			asm volatile ("vmovdqa %0,%%ymm5" : : "m" (v[d][i + 32]));
+			asm volatile ("vpxor %ymm4,%ymm0,%ymm0");
+			asm volatile ("vpxor %ymm5,%ymm1,%ymm1");
+			asm volatile ("vpxor %ymm4,%ymm2,%ymm2");
+			asm volatile ("vpxor %ymm5,%ymm3,%ymm3");
+		}
+		asm volatile ("vpxor %0,%%ymm0,%%ymm0" : : "m" (p[i]));
+		asm volatile ("vpxor %0,%%ymm1,%%ymm1" : : "m" (p[i + 32]));
+		asm volatile ("vpxor %0,%%ymm2,%%ymm2" : : "m" (q[i]));
+		asm volatile ("vpxor %0,%%ymm3,%%ymm3" : : "m" (q[i + 32]));
+		asm volatile ("vpor %ymm1,%ymm0,%ymm0");
+		asm volatile ("vpor %ymm3,%ymm2,%ymm2");
+		asm volatile ("vptest %%ymm0,%%ymm0\n\tsetnz %0" : "=qm" (mp));
+		asm volatile ("vptest %%ymm2,%%ymm2\n\tsetnz %0" : "=qm" (mq));
+		ep |= mp;
+		eq |= mq;
+	}
+
+	raid_avx_end();
+
+	return ep | eq << 1;
+}
+#endif
+
 #if defined(CONFIG_X86_64) && defined(CONFIG_SSE2)
 /*
  * GEN2 (RAID6 with powers of 2) SSE2 implementation
@@ -247,6 +496,7 @@ void raid_gen2_sse2ext(int nd, size_t size, void **vv)
 	asm volatile ("movdqa %0,%%xmm15" : : "m" (gfconst16.poly[0]));
 
 	for (i = 0; i < size; i += 64) {
+		asm volatile ("prefetcht0 %0" : : "m" (v[l][i + RAID_PREFETCH]));
 		asm volatile ("movdqa %0,%%xmm0" : : "m" (v[l][i]));
 		asm volatile ("movdqa %0,%%xmm1" : : "m" (v[l][i + 16]));
 		asm volatile ("movdqa %0,%%xmm2" : : "m" (v[l][i + 32]));
@@ -277,6 +527,7 @@ void raid_gen2_sse2ext(int nd, size_t size, void **vv)
 			asm volatile ("pxor %xmm10,%xmm6");
 			asm volatile ("pxor %xmm11,%xmm7");
 
+			asm volatile ("prefetcht0 %0" : : "m" (v[d][i + RAID_PREFETCH]));
 			asm volatile ("movdqa %0,%%xmm8" : : "m" (v[d][i]));
 			asm volatile ("movdqa %0,%%xmm9" : : "m" (v[d][i + 16]));
 			asm volatile ("movdqa %0,%%xmm10" : : "m" (v[d][i + 32]));
@@ -1984,7 +2235,7 @@ void raid_gen6_avx2ext(int nd, size_t size, void **vv)
 /*
  * RAID recovering for one disk SSSE3 implementation
  */
-void raid_rec1_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec1_ssse3(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
 	uint8_t *p;
@@ -1993,6 +2244,7 @@ void raid_rec1_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 	uint8_t V;
 	size_t i;
 
+	(void)cache; /* unused, it doesn't invert a matrix */
 	(void)nr; /* unused, it's always 1 */
 
 	/* if it's RAID5 uses the faster function */
@@ -2043,26 +2295,20 @@ void raid_rec1_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering for two disks SSSE3 implementation
  */
-void raid_rec2_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec2_ssse3(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
 	const int N = 2;
 	uint8_t *p[N];
 	uint8_t *pa[N];
-	uint8_t G[N * N];
 	uint8_t V[N * N];
 	size_t i;
-	int j, k;
+	int j;
 
 	(void)nr; /* unused, it's always 2 */
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
+	/* invert the coefficients matrix to solve the system of linear equations */
+	raid_invert_coeff(cache, N, id, ip, V);
 
 	/* compute delta parity */
 	raid_delta_gen(N, id, ip, nd, size, vv);
@@ -2149,26 +2395,20 @@ void raid_rec2_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering SSSE3 implementation
  */
-void raid_recX_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_recX_ssse3(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
 	int N = nr;
 	uint8_t *p[RAID_PARITY_MAX];
 	uint8_t *pa[RAID_PARITY_MAX];
-	uint8_t G[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	uint8_t V[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	uint8_t buffer[RAID_PARITY_MAX*16+16];
 	uint8_t *pd = __align_ptr(buffer, 16);
 	size_t i;
 	int j, k;
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
+	/* invert the coefficients matrix to solve the system of linear equations */
+	raid_invert_coeff(cache, N, id, ip, V);
 
 	/* compute delta parity */
 	raid_delta_gen(N, id, ip, nd, size, vv);
@@ -2225,7 +2465,7 @@ void raid_recX_ssse3(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering for one disk AVX2 implementation
  */
-void raid_rec1_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec1_avx2(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
 	uint8_t *p;
@@ -2234,6 +2474,7 @@ void raid_rec1_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 	uint8_t V;
 	size_t i;
 
+	(void)cache; /* unused, it doesn't invert a matrix */
 	(void)nr; /* unused, it's always 1 */
 
 	/* if it's RAID5 uses the faster function */
@@ -2281,26 +2522,20 @@ void raid_rec1_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering for two disks AVX2 implementation
  */
-void raid_rec2_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_rec2_avx2(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
 	const int N = 2;
 	uint8_t *p[N];
 	uint8_t *pa[N];
-	uint8_t G[N * N];
 	uint8_t V[N * N];
 	size_t i;
-	int j, k;
+	int j;
 
 	(void)nr; /* unused, it's always 2 */
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
+	/* invert the coefficients matrix to solve the system of linear equations */
+	raid_invert_coeff(cache, N, id, ip, V);
 
 	/* compute delta parity */
 	raid_delta_gen(N, id, ip, nd, size, vv);
@@ -2379,26 +2614,20 @@ void raid_rec2_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
 /*
  * RAID recovering AVX2 implementation
  */
-void raid_recX_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv)
+void raid_recX_avx2(struct raid_cache *cache, int nr, int *id, int *ip, int nd, size_t size, void **vv)
 {
 	uint8_t **v = (uint8_t **)vv;
 	int N = nr;
 	uint8_t *p[RAID_PARITY_MAX];
 	uint8_t *pa[RAID_PARITY_MAX];
-	uint8_t G[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	uint8_t V[RAID_PARITY_MAX * RAID_PARITY_MAX];
 	uint8_t buffer[RAID_PARITY_MAX*32+32];
 	uint8_t *pd = __align_ptr(buffer, 32);
 	size_t i;
 	int j, k;
 
-	/* setup the coefficients matrix */
-	for (j = 0; j < N; ++j)
-		for (k = 0; k < N; ++k)
-			G[j * N + k] = A(ip[j], id[k]);
-
-	/* invert it to solve the system of linear equations */
-	raid_invert(G, V, N);
+	/* invert the coefficients matrix to solve the system of linear equations */
+	raid_invert_coeff(cache, N, id, ip, V);
 
 	/* compute delta parity */
 	raid_delta_gen(N, id, ip, nd, size, vv);